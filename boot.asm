@@ -2,8 +2,8 @@ section .multiboot
 align 4
 multiboot_header:
     dd 0x1BADB002      ; Multiboot magic number
-    dd 0x0             ; Flags (set as needed)
-    dd -(0x1BADB002 + 0x0)
+    dd 0x3             ; Flags: page align modules, provide the memory map
+    dd -(0x1BADB002 + 0x3)
 
 section .bss
 align 16
@@ -1,5 +1,11 @@
 [bits 32]
 global isr_stub
+global page_fault_task
+global device_not_available_stub
+global user_fault_stub, user_fault_error_stub
+extern page_fault_handler
+extern process_fault_exit
+extern kernel_tss
 
 isr_stub:
     pusha           ; Save registers
@@ -7,3 +13,39 @@ isr_stub:
 
     hlt             ; Halt CPU
     jmp 1b          ; Jump back to label 1
+
+; Faults ring 3 can raise at will, such as #UD or #GP, end the process when
+; they come from there and halt like any other exception otherwise
+user_fault_stub:
+    test dword [esp+4], 3   ; RPL of the faulting CS
+    jz isr_stub
+    jmp user_fault_exit
+
+; The same for a fault that pushes an error code in front of CS
+user_fault_error_stub:
+    test dword [esp+8], 3
+    jz isr_stub
+
+user_fault_exit:
+    mov ax, 0x10            ; kernel data, as in gdt.h
+    mov ds, ax
+    mov es, ax
+    cld
+    mov esp, [kernel_tss+4] ; ESP0: the frame is never returned through
+    sti
+    call process_fault_exit
+
+; Vector 14 is a task gate, so this runs on its own TSS and stack even when
+; the fault was a write to the stack the faulting code was using.
+page_fault_task:
+    mov eax, cr2
+    push eax                ; faulting address; the CPU already pushed the error code
+    call page_fault_handler
+    add esp, 8              ; drop the address and the error code
+    iretd                   ; NT is set, so this switches back to the faulting task
+    jmp page_fault_task     ; the next fault resumes the task here
+
+; Every hardware task switch sets CR0.TS; clear it on first FPU/SSE use
+device_not_available_stub:
+    clts
+    iretd
@@ -1,9 +1,16 @@
 #include "idt.h"
+#include "../keyboard/gdt.h"
 
 struct idt_entry idt[256];
 struct idt_ptr idtp;
 
+static uint8_t fault_task_stack[4096] __attribute__((aligned(16)));
+
 extern void isr_stub();       
+extern void page_fault_task();
+extern void device_not_available_stub();
+extern void user_fault_stub();
+extern void user_fault_error_stub();
 extern void idt_load(uint32_t);
 
 void idt_set_gate(uint8_t num, uint32_t base, uint16_t sel, uint8_t flags)
@@ -21,6 +28,21 @@ void idt_install()
     {
         idt_set_gate(i, (uint32_t)isr_stub, 0x08, 0x8E);
     }
+
+    idt_set_gate(7, (uint32_t)device_not_available_stub, 0x08, 0x8E);
+
+    // Divide error, invalid opcode, general protection
+    idt_set_gate(0, (uint32_t)user_fault_stub, 0x08, 0x8E);
+    idt_set_gate(6, (uint32_t)user_fault_stub, 0x08, 0x8E);
+    idt_set_gate(13, (uint32_t)user_fault_error_stub, 0x08, 0x8E);
+
+    // Page faults switch to a task of their own: 0x85 = present task gate, the offset is unused
+    uint32_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    tss_setup_task(&fault_tss, (uint32_t)page_fault_task,
+                   (uint32_t)(fault_task_stack + sizeof(fault_task_stack)), cr3);
+    idt_set_gate(14, 0, GDT_FAULT_TSS, 0x85);
+
     idtp.limit = (sizeof(struct idt_entry) * 256) - 1;
     idtp.base = (uint32_t)&idt;
     idt_load((uint32_t)&idtp);
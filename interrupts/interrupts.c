@@ -2,6 +2,7 @@
 #include "interrupts.h"
 #include "../keyboard/io.h"
 #include "idt.h" // For idt_set_gate
+#include "timer.h"
 interrupt_handler_t interrupt_handlers[IDT_ENTRIES];
 
 void register_interrupt_handler(uint8_t n, interrupt_handler_t handler)
@@ -20,6 +21,10 @@ void irq_handler(uint8_t irq)
 void common_irq_handler(uint32_t irq_num)
 {
     uint8_t irq = irq_num & 0xFF; 
+    if (irq != 0)
+    {
+        timer_irq_enter();
+    }
     irq_handler(irq);
     if (irq >= 8)
     {
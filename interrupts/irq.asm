@@ -5,13 +5,25 @@ global irq0_stub, irq1_stub, irq2_stub, irq3_stub, irq4_stub
 global irq5_stub, irq6_stub, irq7_stub, irq8_stub, irq9_stub
 global irq10_stub, irq11_stub, irq12_stub, irq13_stub, irq14_stub, irq15_stub
 extern common_irq_handler
+extern irq_preempt
+
+%define KERNEL_DATA_SEL 0x10    ; must match gdt.h
 
 %macro IRQ_STUB 1
 irq%1_stub:
     pusha                  ; Save registers
+    push ds              ; Ring 3 may have left anything in these
+    push es
+    mov ax, KERNEL_DATA_SEL
+    mov ds, ax
+    mov es, ax
+    cld
     push dword %1        ; <-- Push the IRQ number as a full 32-bit value
     call common_irq_handler
     add esp, 4           ; Clean up the pushed 32-bit argument
+    call irq_preempt     ; Switches away if the tick used up the slice; resumes here later
+    pop es
+    pop ds
     popa                 ; Restore registers
     iretd                ; Return from interrupt
 %endmacro
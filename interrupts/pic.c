@@ -21,3 +21,9 @@ void pic_remap()
     outb(0x21, a1); 
     outb(0xA0, a2);
 }
+
+void pic_unmask_irq(uint8_t irq)
+{
+    uint16_t port = irq < 8 ? 0x21 : 0xA1;
+    outb(port, inb(port) & ~(1 << (irq & 7)));
+}
@@ -1,6 +1,9 @@
 #ifndef PIC_H
 #define PIC_H
 
+#include <stdint.h>
+
 void pic_remap();
+void pic_unmask_irq(uint8_t irq);
 
 #endif
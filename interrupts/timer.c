@@ -0,0 +1,138 @@
+#include "timer.h"
+#include "interrupts.h"
+#include "pic.h"
+#include "timer_wheel.h"
+#include "../keyboard/io.h"
+#include "../process/sched.h"
+#include "../process/vdso.h"
+
+volatile uint32_t timer_ticks = 0;
+static uint32_t timer_hz = 0;
+static uint32_t pit_divisor = 0;
+
+// Tickless idle: timer_idle() swaps the periodic tick for a one-shot and the
+// next interrupt of any kind brings timer_ticks back up to date
+bool timer_nohz = true;
+static bool tick_stopped = false;
+static uint64_t last_tick_tsc = 0;
+static uint32_t ticks_skipped = 0;
+
+// TSC cycles per tick, measured against the PIT over the first ticks; 0 until then
+static uint64_t tsc_per_tick = 0;
+static uint64_t calibrate_start = 0;
+
+static void pit_periodic(void)
+{
+    outb(PIT_COMMAND, 0x34);    // channel 0, lobyte/hibyte, mode 2
+    outb(PIT_CHANNEL0, pit_divisor & 0xFF);
+    outb(PIT_CHANNEL0, (pit_divisor >> 8) & 0xFF);
+}
+
+static void pit_oneshot(uint16_t count)
+{
+    outb(PIT_COMMAND, 0x30);    // channel 0, lobyte/hibyte, mode 0
+    outb(PIT_CHANNEL0, count & 0xFF);
+    outb(PIT_CHANNEL0, (count >> 8) & 0xFF);
+}
+
+// Credits the ticks nobody was interrupted for and goes back to periodic
+static void tick_restart(uint32_t slept)
+{
+    timer_ticks += slept;
+    ticks_skipped += slept;
+    tick_stopped = false;
+    pit_periodic();
+}
+
+static void timer_handler(void)
+{
+    uint64_t now = rdtsc();
+    if (tick_stopped) {
+        // timer_idle()'s one-shot lands on a tick boundary; this interrupt
+        // stands for the last of the ticks slept through
+        uint32_t slept = (uint32_t)((now - last_tick_tsc + tsc_per_tick / 2) / tsc_per_tick);
+        tick_restart(slept > 0 ? slept - 1 : 0);
+    }
+    last_tick_tsc = now;
+    timer_ticks++;
+    if (timer_ticks == 1) {
+        calibrate_start = rdtsc();
+    } else if (timer_ticks == 1 + TIMER_CALIBRATE_TICKS) {
+        tsc_per_tick = (rdtsc() - calibrate_start) / TIMER_CALIBRATE_TICKS;
+    }
+    vdso_update_clock(timer_ticks, last_tick_tsc, tsc_per_tick);
+    // Expired timers first, so whoever they wake is considered by this tick
+    timer_wheel_run(timer_ticks);
+    sched_tick();
+}
+
+// Programs PIT channel 0 as a rate generator firing IRQ0 hz times a second
+void timer_init(uint32_t hz)
+{
+    uint32_t divisor = PIT_FREQUENCY / hz;
+    if (divisor == 0) divisor = 1;
+    if (divisor > 0xFFFF) divisor = 0xFFFF;
+    timer_hz = PIT_FREQUENCY / divisor;
+    pit_divisor = divisor;
+
+    register_interrupt_handler(32, timer_handler);
+
+    pit_periodic();
+    pic_unmask_irq(0);
+}
+
+// Every IRQ but the timer's own calls this first, so a device interrupt that
+// ends a tickless stretch sees the right tick and leaves the tick running
+void timer_irq_enter(void)
+{
+    if (!tick_stopped) {
+        return;
+    }
+    uint32_t slept = (uint32_t)((rdtsc() - last_tick_tsc) / tsc_per_tick);
+    last_tick_tsc += (uint64_t)slept * tsc_per_tick;
+    tick_restart(slept);
+    vdso_update_clock(timer_ticks, last_tick_tsc, tsc_per_tick);
+}
+
+// The idle loop's hlt. With nothing runnable, sleeps until the next pending
+// timer instead of taking every tick, as far ahead as the PIT's 16-bit
+// counter reaches. Returns after the next interrupt, interrupts on.
+void timer_idle(void)
+{
+    asm volatile("cli");
+    if (timer_nohz && tsc_per_tick != 0 && !need_resched && !tick_stopped) {
+        uint32_t max_ticks = 0xFFFF / pit_divisor;
+        uint32_t delta = max_ticks > 1 ? timer_wheel_next_expiry(max_ticks - 1) - timer_ticks : 0;
+        uint64_t target = last_tick_tsc + (uint64_t)delta * tsc_per_tick;
+        uint64_t now = rdtsc();
+        if (delta > 1 && target > now) {
+            uint64_t count = (target - now) * pit_divisor / tsc_per_tick;
+            if (count == 0) count = 1;
+            if (count > 0xFFFF) count = 0xFFFF;
+            pit_oneshot((uint16_t)count);
+            tick_stopped = true;
+        }
+    }
+    asm volatile("sti; hlt");
+}
+
+uint32_t timer_skipped_ticks(void)
+{
+    return ticks_skipped;
+}
+
+uint32_t timer_frequency(void)
+{
+    return timer_hz;
+}
+
+// Rounds up, and stays within 32 bits for any ms
+uint32_t timer_ms_to_ticks(uint32_t ms)
+{
+    return ms / 1000 * timer_hz + ((ms % 1000) * timer_hz + 999) / 1000;
+}
+
+uint64_t timer_tsc_per_tick(void)
+{
+    return tsc_per_tick;
+}
@@ -0,0 +1,25 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PIT_FREQUENCY 1193182   // input clock of the 8253/8254, Hz
+#define PIT_CHANNEL0  0x40
+#define PIT_COMMAND   0x43
+
+#define TIMER_HZ 100            // default tick rate
+#define TIMER_CALIBRATE_TICKS 10    // ticks the TSC is measured over
+
+extern volatile uint32_t timer_ticks;
+extern bool timer_nohz;         // stop the tick while idle
+
+void timer_init(uint32_t hz);
+uint32_t timer_frequency(void);
+uint32_t timer_ms_to_ticks(uint32_t ms);
+uint64_t timer_tsc_per_tick(void);
+void timer_irq_enter(void);
+void timer_idle(void);
+uint32_t timer_skipped_ticks(void);
+
+#endif
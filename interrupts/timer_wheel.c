@@ -0,0 +1,149 @@
+#include <stddef.h>
+#include "timer_wheel.h"
+#include "../keyboard/io.h"
+
+#define ROOT_MASK (TWHEEL_ROOT_SIZE - 1)
+#define LEVEL_MASK (TWHEEL_LEVEL_SIZE - 1)
+#define LEVEL_SHIFT(n) (TWHEEL_ROOT_BITS + (n) * TWHEEL_LEVEL_BITS)
+#define LEVEL_INDEX(tick, n) (((tick) >> LEVEL_SHIFT(n)) & LEVEL_MASK)
+
+static ktimer_t* root_wheel[TWHEEL_ROOT_SIZE];
+static ktimer_t* level_wheel[TWHEEL_LEVELS][TWHEEL_LEVEL_SIZE];
+static uint32_t wheel_tick = 0;     // next tick the root wheel will process
+
+static void slot_add(ktimer_t** slot, ktimer_t* timer) {
+    timer->next = *slot;
+    if (*slot != NULL) {
+        (*slot)->pprev = &timer->next;
+    }
+    *slot = timer;
+    timer->pprev = slot;
+}
+
+static void timer_unlink(ktimer_t* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+// Files a timer under the coarsest wheel whose range still covers it
+static void wheel_add(ktimer_t* timer) {
+    uint32_t expires = timer->expires;
+    uint32_t delta = expires - wheel_tick;
+    ktimer_t** slot;
+
+    if ((int32_t)delta < 0) {
+        // Already due: run it on the next tick processed
+        slot = &root_wheel[wheel_tick & ROOT_MASK];
+    } else if (delta < (1u << LEVEL_SHIFT(0))) {
+        slot = &root_wheel[expires & ROOT_MASK];
+    } else {
+        int level = 0;
+        while (level < TWHEEL_LEVELS - 1 && delta >= (1u << LEVEL_SHIFT(level + 1))) {
+            level++;
+        }
+        slot = &level_wheel[level][LEVEL_INDEX(expires, level)];
+    }
+    slot_add(slot, timer);
+}
+
+// Re-files every timer in one slot of an upper wheel; they all land lower down
+static uint32_t cascade(int level, uint32_t index) {
+    ktimer_t* timer = level_wheel[level][index];
+    level_wheel[level][index] = NULL;
+    while (timer != NULL) {
+        ktimer_t* next = timer->next;
+        wheel_add(timer);
+        timer = next;
+    }
+    return index;
+}
+
+void ktimer_init(ktimer_t* timer, ktimer_fn_t fn, void* data) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->fn = fn;
+    timer->data = data;
+}
+
+// Re-arming a pending timer moves it
+void ktimer_arm(ktimer_t* timer, uint32_t expires) {
+    uint32_t flags = irq_save();
+    if (timer->pprev != NULL) {
+        timer_unlink(timer);
+    }
+    timer->expires = expires;
+    wheel_add(timer);
+    irq_restore(flags);
+}
+
+void ktimer_cancel(ktimer_t* timer) {
+    uint32_t flags = irq_save();
+    if (timer->pprev != NULL) {
+        timer_unlink(timer);
+    }
+    irq_restore(flags);
+}
+
+bool ktimer_pending(const ktimer_t* timer) {
+    return timer->pprev != NULL;
+}
+
+static bool upper_wheels_empty(void) {
+    for (int level = 0; level < TWHEEL_LEVELS; level++) {
+        for (int index = 0; index < TWHEEL_LEVEL_SIZE; index++) {
+            if (level_wheel[level][index] != NULL) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// First tick, at most limit ticks ahead, that the wheel has work on: a root
+// slot holding timers, or the next cascade if the upper wheels hold any,
+// since their timers only get an exact slot then. Interrupts must be off.
+uint32_t timer_wheel_next_expiry(uint32_t limit) {
+    uint32_t delta = limit;
+    uint32_t span = limit < TWHEEL_ROOT_SIZE ? limit : TWHEEL_ROOT_SIZE;
+    for (uint32_t i = 0; i < span; i++) {
+        if (root_wheel[(wheel_tick + i) & ROOT_MASK] != NULL) {
+            delta = i;
+            break;
+        }
+    }
+
+    uint32_t to_cascade = (TWHEEL_ROOT_SIZE - (wheel_tick & ROOT_MASK)) & ROOT_MASK;
+    if (to_cascade < delta && !upper_wheels_empty()) {
+        delta = to_cascade;
+    }
+    return wheel_tick + delta;
+}
+
+// Called from the timer interrupt with the current tick. Catches up on any
+// ticks missed since the last call, cascading whenever the root wheel wraps.
+void timer_wheel_run(uint32_t now) {
+    while ((int32_t)(now - wheel_tick) >= 0) {
+        uint32_t index = wheel_tick & ROOT_MASK;
+        if (index == 0) {
+            for (int level = 0; level < TWHEEL_LEVELS; level++) {
+                if (cascade(level, LEVEL_INDEX(wheel_tick, level)) != 0) {
+                    break;
+                }
+            }
+        }
+
+        // Unlinked one at a time so a callback may cancel or re-arm any timer;
+        // nothing it arms can land back in this slot
+        wheel_tick++;
+        while (root_wheel[index] != NULL) {
+            ktimer_t* timer = root_wheel[index];
+            timer_unlink(timer);
+            timer->fn(timer->data);
+        }
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Hierarchical timing wheel: a 256-slot wheel for the next 256 ticks and
+// four 64-slot wheels above it, together covering every 32-bit expiry.
+// Timers cascade one level down each time the wheel below wraps.
+#define TWHEEL_ROOT_BITS 8
+#define TWHEEL_LEVEL_BITS 6
+#define TWHEEL_ROOT_SIZE (1 << TWHEEL_ROOT_BITS)
+#define TWHEEL_LEVEL_SIZE (1 << TWHEEL_LEVEL_BITS)
+#define TWHEEL_LEVELS 4         // wheels above the root one
+
+typedef void (*ktimer_fn_t)(void* data);
+
+// Embedded in its owner, so arming never allocates. pprev points at whatever
+// links to the timer, which makes cancelling O(1); it is NULL when idle.
+typedef struct ktimer {
+    struct ktimer* next;
+    struct ktimer** pprev;
+    uint32_t expires;       // absolute tick
+    ktimer_fn_t fn;         // runs from the timer interrupt, interrupts off
+    void* data;
+} ktimer_t;
+
+void ktimer_init(ktimer_t* timer, ktimer_fn_t fn, void* data);
+void ktimer_arm(ktimer_t* timer, uint32_t expires);
+void ktimer_cancel(ktimer_t* timer);
+bool ktimer_pending(const ktimer_t* timer);
+
+void timer_wheel_run(uint32_t now);
+uint32_t timer_wheel_next_expiry(uint32_t limit);
+
+#endif
@@ -15,15 +15,22 @@ __attribute__((used)) static const struct {
 #include "keyboard/gdt.h"
 #include "keyboard/keyboard.h"
 #include "keyboard/string.h"
+#include "keyboard/io.h"
 
 #include "process/process.h"
+#include "process/sched.h"
+#include "process/group.h"
 #include "process/syscall.h"   
+#include "process/vdso.h"
 
 #include "memory/memory.h"
+#include "memory/paging.h"
+#include "memory/swap.h"
 
 #include "interrupts/idt.h"
 #include "interrupts/pic.h"
 #include "interrupts/interrupts.h"
+#include "interrupts/timer.h"
 
 #include "filesystem/filesystem.h" 
 #include <string.h>
@@ -35,6 +42,7 @@ extern void dummy_process_2(void);
 extern void dummy_process_3(void);
 extern void syscall_test(void);
 extern void process_test(void);
+extern uint8_t user_test_start[], user_test_end[];
 
 int atoi(const char *s) {
     int num = 0;
@@ -141,6 +149,17 @@ void scroll_screen(void)
     vga_col = 0;
 }
 
+void clear_screen(void)
+{
+    volatile char *video = VGA_MEMORY;
+    for (int i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++){
+        video[i*2] = ' ';
+        video[i*2 + 1] = 0x07;
+    }
+    vga_row = 0;
+    vga_col = 0;
+}
+
 void putchar(char c)
 {
     volatile char *video = VGA_MEMORY;
@@ -159,7 +178,10 @@ void putchar(char c)
 
 void print_to_screen(const char *message)
 {
+    // Processes can be preempted mid-line; keep the cursor consistent
+    uint32_t flags = irq_save();
     while(*message){ putchar(*message); message++; }
+    irq_restore(flags);
 }
 
 #define MAX_INPUT_LENGTH 128
@@ -181,13 +203,60 @@ extern volatile char input_line[BUFFER_SIZE];
 
 void read_line(char *buffer, int max_length)
 {
-    while(!input_ready){ asm volatile("hlt"); }
+    while(!input_ready){
+        if(!memory_idle_refill()) timer_idle();
+    }
     int i = 0;
     while(input_line[i] != '\0' && i < max_length-1){ buffer[i] = input_line[i]; i++; }
     buffer[i] = '\0';
     input_ready = 0;
 }
 
+// Redraws the process table once a second until a line is entered
+static void top_loop(void)
+{
+    input_ready = 0;
+    while (!input_ready) {
+        clear_screen();
+        print_to_screen("top - press Enter to return\n");
+        process_print_stats(print_to_screen, PROCESS_STATS_TOP);
+        uint32_t until = timer_ticks + timer_frequency();
+        while (!input_ready && (int32_t)(timer_ticks - until) < 0) {
+            timer_idle();
+        }
+    }
+    input_ready = 0;
+}
+
+// Reports a process that could not be created, or that admission control
+// kept out of the default policy. Interrupts stay off until it has been
+// looked at, so it can't have run, exited and been freed by then.
+static void report_new_process(PCB* process, uint32_t flags)
+{
+    if (!process) {
+        irq_restore(flags);
+        print_to_screen("Error: Failed to create process.\n");
+        return;
+    }
+    int refused = process->policy != sched_default_policy;
+    const char* policy = sched_policy_name(process->policy);
+    irq_restore(flags);
+    if (refused) {
+        print_to_screen("Admission refused for ");
+        print_to_screen(sched_policy_name(sched_default_policy));
+        print_to_screen("; running under ");
+        print_to_screen(policy);
+        print_to_screen(".\n");
+    }
+}
+
+static void queue_process(void (*func)(void), int priority)
+{
+    uint32_t flags = irq_save();
+    report_new_process(create_process(get_new_pid(), (uint32_t *) func, priority,
+                                      SCHED_DL_PERIOD, SCHED_DL_BUDGET), flags);
+}
+
 void cli_loop(void) {
     char input[MAX_INPUT_LENGTH];
 
@@ -205,7 +274,7 @@ void cli_loop(void) {
         else if (strcmp(token1, "process") == 0) {
             char *token2 = strtok(NULL, " \t");
             if (!token2) {
-                print_to_screen("Usage: process <dummy1|dummy2|dummy3|syscall test|process test|start> [priority]\n");
+                print_to_screen("Usage: process <dummy1|dummy2|dummy3|syscall test|process test|user test|start> [priority]\n");
                 continue;
             }
             if (strcmp(token2, "start") == 0) {
@@ -221,24 +290,27 @@ void cli_loop(void) {
             if (strcmp(token2, "syscall") == 0 && token3 && strcmp(token3, "test") == 0) {
                 if (token4) priority = atoi(token4);
                 print_to_screen("Queueing syscall_test process...\n");
-                
-                create_process(
-                    get_new_pid(),
-                    (uint32_t *) syscall_test,
-                    priority, 1, 2
-                );
+                queue_process(syscall_test, priority);
                 continue;
             }
 
             if (strcmp(token2, "process") == 0 && token3 && strcmp(token3, "test") == 0) {
                 if (token4) priority = atoi(token4);
                 print_to_screen("Queueing process_test process...\n");
-        
-                create_process(
-                    get_new_pid(),
-                    (uint32_t *) process_test,
-                    priority, 1, 2
-                );
+                queue_process(process_test, priority);
+                continue;
+            }
+
+            if (strcmp(token2, "user") == 0 && token3 && strcmp(token3, "test") == 0) {
+                if (token4) priority = atoi(token4);
+                print_to_screen("Queueing ring 3 user_test process...\n");
+                uint32_t flags = irq_save();
+                report_new_process(create_user_process(
+                        get_new_pid(),
+                        user_test_start,
+                        (uint32_t)(user_test_end - user_test_start),
+                        0, priority, SCHED_DL_PERIOD, SCHED_DL_BUDGET
+                    ), flags);
                 continue;
             }
 
@@ -250,13 +322,7 @@ void cli_loop(void) {
             for (int i = 0; i < num_process_commands; i++) {
                 if (strcmp(token2, process_commands[i].name) == 0) {
                     print_to_screen("Queueing process...\n");
-                    
-                    create_process(
-                        get_new_pid(),
-                        (uint32_t *) process_commands[i].func,
-                        priority,
-                        1, 2
-                    );
+                    queue_process(process_commands[i].func, priority);
                     found = 1;
                     break;
                 }
@@ -363,8 +429,182 @@ void cli_loop(void) {
         else if (strcmp(token1, "ls") == 0) {
             list_files();
         }
+        else if (strcmp(token1, "mem") == 0) {
+            char *operation = strtok(NULL, " \t");
+            if (operation && strcmp(operation, "map") == 0) {
+                memory_print_map();
+            } else if (operation && strcmp(operation, "stats") == 0) {
+                char *target = strtok(NULL, " \t");
+                if (target && strcmp(target, "serial") == 0) {
+                    memory_print_stats(serial_print);
+                    print_to_screen("Memory statistics written to serial port.\n");
+                } else {
+                    memory_print_stats(print_to_screen);
+                }
+            } else if (operation && strcmp(operation, "swap") == 0) {
+                char *action = strtok(NULL, " \t");
+                if (action && strcmp(action, "reclaim") == 0) {
+                    char buffer[16];
+                    int_to_dec((uint32_t)swap_reclaim(SWAP_MAX_SLOTS), buffer);
+                    print_to_screen("Reclaimed pages: ");
+                    print_to_screen(buffer);
+                    print_to_screen("\n");
+                }
+                swap_print_stats();
+            } else {
+                print_to_screen("Usage: mem map | mem stats [serial] | mem swap [reclaim]\n");
+            }
+        }
+        else if (strcmp(token1, "bench") == 0) {
+            char *target = strtok(NULL, " \t");
+            if (target && strcmp(target, "mem") == 0) {
+                memory_bench();
+            } else if (target && strcmp(target, "ctxsw") == 0) {
+                context_switch_bench();
+            } else if (target && strcmp(target, "syscall") == 0) {
+                syscall_bench();
+            } else {
+                print_to_screen("Usage: bench mem | bench ctxsw | bench syscall\n");
+            }
+        }
+        else if (strcmp(token1, "sched") == 0) {
+            char *operation = strtok(NULL, " \t");
+            if (operation && strcmp(operation, "dl") == 0) {
+                // Period and budget are in ticks
+                char *pid_str = strtok(NULL, " \t");
+                char *period_str = strtok(NULL, " \t");
+                char *budget_str = strtok(NULL, " \t");
+                if (!pid_str) {
+                    sched_print_dl_stats(print_to_screen);
+                    continue;
+                }
+                if (!period_str || !budget_str) {
+                    print_to_screen("Usage: sched dl [pid period budget]\n");
+                    continue;
+                }
+                PCB* target = process_find((uint32_t)atoi(pid_str));
+                if (!target) {
+                    print_to_screen("Error: No such process.\n");
+                } else if (sched_set_deadline(target, (uint32_t)atoi(period_str), (uint32_t)atoi(budget_str)) != 0) {
+                    print_to_screen("Error: Admission refused; utilisation would exceed 100%.\n");
+                } else {
+                    print_to_screen("Deadline parameters set.\n");
+                }
+                continue;
+            }
+            if (!operation || strcmp(operation, "policy") != 0) {
+                print_to_screen("Usage: sched policy [edf|sjf|prio|mlfq|cfs] [pid] | sched dl [pid period budget]\n");
+                continue;
+            }
+            char *name = strtok(NULL, " \t");
+            char *pid_str = strtok(NULL, " \t");
+            if (!name) {
+                print_to_screen("Default policy: ");
+                print_to_screen(sched_policy_name(sched_default_policy));
+                print_to_screen("\n");
+                continue;
+            }
+            int policy = sched_policy_from_name(name);
+            if (policy < 0) {
+                print_to_screen("Error: Unknown policy. Use 'edf', 'sjf', 'prio', 'mlfq' or 'cfs'.\n");
+                continue;
+            }
+            if (!pid_str) {
+                int refused = sched_set_policy(policy);
+                print_to_screen("All processes now use ");
+                print_to_screen(name);
+                print_to_screen(".\n");
+                if (refused > 0) {
+                    char buffer[16];
+                    int_to_dec((uint32_t)refused, buffer);
+                    print_to_screen(buffer);
+                    print_to_screen(" refused admission and kept their policy.\n");
+                }
+                continue;
+            }
+            PCB* target = process_find((uint32_t)atoi(pid_str));
+            if (!target) {
+                print_to_screen("Error: No such process.\n");
+            } else if (sched_set_process_policy(target, policy) != 0) {
+                print_to_screen("Error: Admission refused.\n");
+            } else {
+                print_to_screen("Policy changed.\n");
+            }
+        }
+        else if (strcmp(token1, "group") == 0) {
+            char *operation = strtok(NULL, " \t");
+            char *arg1 = strtok(NULL, " \t");
+            char *arg2 = strtok(NULL, " \t");
+            char *arg3 = strtok(NULL, " \t");
+            if (!operation) {
+                group_print_stats(print_to_screen);
+            } else if (strcmp(operation, "create") == 0 && arg1 && arg2) {
+                sched_group_t* group = group_create((uint32_t)atoi(arg1), (uint32_t)atoi(arg2));
+                if (!group) {
+                    print_to_screen("Error: Bad quota/period or no free group.\n");
+                } else {
+                    char buffer[16];
+                    int_to_dec((uint32_t)group->id, buffer);
+                    print_to_screen("Created group ");
+                    print_to_screen(buffer);
+                    print_to_screen(".\n");
+                }
+            } else if (strcmp(operation, "set") == 0 && arg1 && arg2 && arg3) {
+                sched_group_t* group = group_find(atoi(arg1));
+                if (!group) {
+                    print_to_screen("Error: No such group.\n");
+                } else if (group_set_bandwidth(group, (uint32_t)atoi(arg2), (uint32_t)atoi(arg3)) != 0) {
+                    print_to_screen("Error: Quota must be between 1 ms and the period.\n");
+                } else {
+                    print_to_screen("Bandwidth changed.\n");
+                }
+            } else if (strcmp(operation, "add") == 0 && arg1 && arg2) {
+                // Group 0 takes the process out of its group
+                int id = atoi(arg1);
+                sched_group_t* group = group_find(id);
+                PCB* target = process_find((uint32_t)atoi(arg2));
+                if (id != 0 && !group) {
+                    print_to_screen("Error: No such group.\n");
+                } else if (!target) {
+                    print_to_screen("Error: No such process.\n");
+                } else {
+                    group_attach(target, group);
+                    print_to_screen("Process moved.\n");
+                }
+            } else {
+                print_to_screen("Usage: group [create <quota ms> <period ms> | set <id> <quota ms> <period ms> | add <id> <pid>]\n");
+            }
+        }
+        else if (strcmp(token1, "ps") == 0) {
+            char *target = strtok(NULL, " \t");
+            if (target && strcmp(target, "serial") == 0) {
+                process_print_stats(serial_print, PROCESS_STATS_CSV);
+                print_to_screen("Process statistics written to serial port.\n");
+            } else {
+                process_print_stats(print_to_screen, PROCESS_STATS_PS);
+            }
+        }
+        else if (strcmp(token1, "top") == 0) {
+            top_loop();
+        }
+        else if (strcmp(token1, "tick") == 0) {
+            char *mode = strtok(NULL, " \t");
+            if (mode && strcmp(mode, "nohz") == 0) {
+                timer_nohz = true;
+            } else if (mode && strcmp(mode, "periodic") == 0) {
+                timer_nohz = false;
+            } else if (mode) {
+                print_to_screen("Usage: tick [nohz|periodic]\n");
+                continue;
+            }
+            char buffer[16];
+            print_to_screen(timer_nohz ? "Tick: nohz, " : "Tick: periodic, ");
+            int_to_dec(timer_skipped_ticks(), buffer);
+            print_to_screen(buffer);
+            print_to_screen(" ticks skipped while idle\n");
+        }
         else {
-            print_to_screen("Unknown command. Use 'process', 'file', 'ls', or 'exit'.\n");
+            print_to_screen("Unknown command. Use 'process', 'file', 'ls', 'mem', 'bench', 'sched', 'group', 'ps', 'top', 'tick', or 'exit'.\n");
         }
     }
 }
@@ -380,8 +620,14 @@ void kernel_main(uint32_t multiboot_info)
         print_to_screen(num);
         print_to_screen("\n");
     }
+    if (string_init_simd()) {
+        debug_print("DEBUG: SSE2 enabled for bulk memory operations.");
+    }
     memory_init(multiboot_info);
     debug_print("DEBUG: Memory initialized.");
+    paging_init();
+    debug_print("DEBUG: Paging initialized.");
+    swap_init();
 
     create_file_system();
     debug_print("DEBUG: Filesystem initialized.");
@@ -392,6 +638,9 @@ void kernel_main(uint32_t multiboot_info)
     idt_install();
     irq_install();
     print_to_screen("DEBUG: IDT and IRQ handlers installed.\n");
+    timer_init(TIMER_HZ);
+    debug_print("DEBUG: PIT programmed, preemptive scheduling enabled.");
+    vdso_init();
     init_keyboard();
     
     print_to_screen("DEBUG: Keyboard initialized. Press keys!\n");
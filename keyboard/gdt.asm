@@ -1,6 +1,7 @@
 ; gdt.asm
 [bits 32]
 global gdt_flush
+global tss_flush
 
 gdt_flush:
     lgdt [eax]         ; Load GDT pointed to by EAX.
@@ -17,3 +18,8 @@ gdt_flush:
     jmp 0x08:.flush   ; Code segment selector (1st descriptor after null: 1*8 = 0x08)
 .flush:
     ret
+
+tss_flush:
+    mov ax, [esp+4]    ; TSS selector
+    ltr ax
+    ret
@@ -1,9 +1,13 @@
 #include "gdt.h"
 
-struct gdt_entry gdt[3];
+struct gdt_entry gdt[GDT_ENTRIES];
 struct gdt_ptr gp;
 
+struct tss_entry kernel_tss;
+struct tss_entry fault_tss;
+
 extern void gdt_flush(uint32_t);
+extern void tss_flush(uint16_t selector);
 
 static void gdt_set_gate(int num, unsigned long base, unsigned long limit,
                          uint8_t access, uint8_t gran)
@@ -19,14 +23,56 @@ static void gdt_set_gate(int num, unsigned long base, unsigned long limit,
     gdt[num].access = access;
 }
 
+static void tss_clear(struct tss_entry* tss)
+{
+    uint8_t* p = (uint8_t*)tss;
+    for (uint32_t i = 0; i < sizeof(struct tss_entry); i++)
+        p[i] = 0;
+    tss->iomap_base = sizeof(struct tss_entry);
+}
+
+// Prepares a TSS that a task gate can switch to: flat kernel segments, interrupts off
+void tss_setup_task(struct tss_entry* tss, uint32_t eip, uint32_t esp, uint32_t cr3)
+{
+    tss_clear(tss);
+    tss->eip = eip;
+    tss->esp = esp;
+    tss->ebp = esp;
+    tss->cr3 = cr3;
+    tss->eflags = 0x2;
+    tss->cs = GDT_KERNEL_CODE;
+    tss->ss = GDT_KERNEL_DATA;
+    tss->ds = GDT_KERNEL_DATA;
+    tss->es = GDT_KERNEL_DATA;
+    tss->fs = GDT_KERNEL_DATA;
+    tss->gs = GDT_KERNEL_DATA;
+}
+
 void gdt_install()
 {
-    gp.limit = (sizeof(struct gdt_entry) * 3) - 1;
+    gp.limit = (sizeof(struct gdt_entry) * GDT_ENTRIES) - 1;
     gp.base = (uint32_t)&gdt;
 
     gdt_set_gate(0, 0, 0, 0, 0);
     gdt_set_gate(1, 0, 0xFFFFFFFF, 0x9A, 0xCF);
     gdt_set_gate(2, 0, 0xFFFFFFFF, 0x92, 0xCF);
+    gdt_set_gate(GDT_USER_CODE / 8, 0, 0xFFFFFFFF, 0xFA, 0xCF);
+    gdt_set_gate(GDT_USER_DATA / 8, 0, 0xFFFFFFFF, 0xF2, 0xCF);
+
+    // The CPU saves the running context into kernel_tss whenever a task gate
+    // fires, and takes the stack from ss0:esp0 on every entry from ring 3
+    tss_clear(&kernel_tss);
+    kernel_tss.ss0 = GDT_KERNEL_DATA;
+    asm volatile("mov %%cr3, %0" : "=r"(kernel_tss.cr3));
+    gdt_set_gate(GDT_KERNEL_TSS / 8, (uint32_t)&kernel_tss, sizeof(struct tss_entry) - 1, 0x89, 0x00);
+    gdt_set_gate(GDT_FAULT_TSS / 8, (uint32_t)&fault_tss, sizeof(struct tss_entry) - 1, 0x89, 0x00);
 
     gdt_flush((uint32_t)&gp);
+    tss_flush(GDT_KERNEL_TSS);
+}
+
+// The kernel stack of whichever process runs next; see do_schedule()
+void tss_set_kernel_stack(uint32_t esp0)
+{
+    kernel_tss.esp0 = esp0;
 }
@@ -3,6 +3,19 @@
 
 #include <stdint.h>
 
+#define GDT_ENTRIES 7
+
+// SYSENTER/SYSEXIT derive every selector from the kernel code one, so the
+// kernel data, user code and user data segments must follow it in this order
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_USER_CODE   0x18
+#define GDT_USER_DATA   0x20
+#define GDT_KERNEL_TSS  0x28    // ESP0 for entries from ring 3; also the state of the interrupted context while a fault task runs
+#define GDT_FAULT_TSS   0x30    // page faults are handled as their own hardware task
+
+#define GDT_RPL_USER    3       // requested privilege level of selectors loaded in ring 3
+
 struct gdt_entry
 {
     uint16_t limit_low;  
@@ -19,6 +32,42 @@ struct gdt_ptr
     uint32_t base;  
 } __attribute__((packed));
 
+struct tss_entry
+{
+    uint32_t prev_tss;
+    uint32_t esp0;
+    uint32_t ss0;
+    uint32_t esp1;
+    uint32_t ss1;
+    uint32_t esp2;
+    uint32_t ss2;
+    uint32_t cr3;
+    uint32_t eip;
+    uint32_t eflags;
+    uint32_t eax;
+    uint32_t ecx;
+    uint32_t edx;
+    uint32_t ebx;
+    uint32_t esp;
+    uint32_t ebp;
+    uint32_t esi;
+    uint32_t edi;
+    uint32_t es;
+    uint32_t cs;
+    uint32_t ss;
+    uint32_t ds;
+    uint32_t fs;
+    uint32_t gs;
+    uint32_t ldt;
+    uint16_t trap;
+    uint16_t iomap_base;
+} __attribute__((packed));
+
+extern struct tss_entry kernel_tss;
+extern struct tss_entry fault_tss;
+
 void gdt_install();
+void tss_set_kernel_stack(uint32_t esp0);
+void tss_setup_task(struct tss_entry* tss, uint32_t eip, uint32_t esp, uint32_t cr3);
 
 #endif
@@ -15,4 +15,48 @@ static inline uint8_t inb(uint16_t port)
     return ret;
 }
 
+static inline uint32_t read_eflags(void)
+{
+    uint32_t flags;
+    asm volatile("pushfl\n\t"
+                 "popl %0"
+                 : "=r"(flags));
+    return flags;
+}
+
+// Interrupts off with the previous state returned, for short critical sections
+static inline uint32_t irq_save(void)
+{
+    uint32_t flags;
+    asm volatile("pushfl\n\t"
+                 "popl %0\n\t"
+                 "cli"
+                 : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint32_t flags)
+{
+    asm volatile("pushl %0\n\t"
+                 "popfl"
+                 : : "r"(flags) : "memory", "cc");
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx)
+{
+    asm volatile("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+static inline uint64_t rdtsc(void)
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value)
+{
+    asm volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
 #endif
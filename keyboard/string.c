@@ -1,4 +1,19 @@
 #include "string.h"
+#include <stdint.h>
+#include "io.h"
+
+#define CR0_MP         0x00000002
+#define CR0_EM         0x00000004
+#define CR4_OSFXSR     0x00000200
+#define CR4_OSXMMEXCPT 0x00000400
+#define CPUID_EDX_FXSR 0x01000000
+#define CPUID_EDX_SSE2 0x04000000
+
+static int simd_enabled = 0;
+// Nothing saves XMM registers across context switches, so the SSE paths run
+// with interrupts off. A page fault inside one (the #PF task copying a COW
+// page) sees simd_busy set and falls back to the integer path.
+static volatile int simd_busy = 0;
 
 size_t strlen(const char* str) {
     size_t len = 0;
@@ -6,16 +21,141 @@ size_t strlen(const char* str) {
     return len;
 }
 
+int string_init_simd(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_EDX_FXSR) || !(edx & CPUID_EDX_SSE2)) {
+        return 0;
+    }
+
+    uint32_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 &= ~CR0_EM;
+    cr0 |= CR0_MP;
+    asm volatile("mov %0, %%cr0" : : "r"(cr0));
+
+    uint32_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    asm volatile("mov %0, %%cr4" : : "r"(cr4));
+
+    simd_enabled = 1;
+    return 1;
+}
+
+static int simd_begin(uint32_t* flags) {
+    if (!simd_enabled || simd_busy) return 0;
+    *flags = irq_save();
+    simd_busy = 1;
+    return 1;
+}
+
+static void simd_end(uint32_t flags) {
+    simd_busy = 0;
+    irq_restore(flags);
+}
+
+// Copy 64 byte blocks into a 16 byte aligned destination
+static void simd_copy_blocks(uint8_t* d, const uint8_t* s, size_t blocks) {
+    while (blocks--) {
+        asm volatile("movdqu   (%1), %%xmm0\n\t"
+                     "movdqu 16(%1), %%xmm1\n\t"
+                     "movdqu 32(%1), %%xmm2\n\t"
+                     "movdqu 48(%1), %%xmm3\n\t"
+                     "movdqa %%xmm0,   (%0)\n\t"
+                     "movdqa %%xmm1, 16(%0)\n\t"
+                     "movdqa %%xmm2, 32(%0)\n\t"
+                     "movdqa %%xmm3, 48(%0)"
+                     : : "r"(d), "r"(s) : "memory");
+        d += 64;
+        s += 64;
+    }
+}
+
+static void simd_set_blocks(uint8_t* d, uint32_t pattern, size_t blocks) {
+    asm volatile("movd %0, %%xmm0\n\t"
+                 "pshufd $0, %%xmm0, %%xmm0"
+                 : : "r"(pattern));
+    while (blocks--) {
+        asm volatile("movdqa %%xmm0,   (%0)\n\t"
+                     "movdqa %%xmm0, 16(%0)\n\t"
+                     "movdqa %%xmm0, 32(%0)\n\t"
+                     "movdqa %%xmm0, 48(%0)"
+                     : : "r"(d) : "memory");
+        d += 64;
+    }
+}
+
+static inline void copy_bytes(uint8_t* d, const uint8_t* s, size_t n) {
+    asm volatile("cld\n\t"
+                 "rep movsb"
+                 : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+}
+
+static inline void copy_dwords(uint8_t* d, const uint8_t* s, size_t n) {
+    asm volatile("cld\n\t"
+                 "rep movsl"
+                 : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+}
+
 void* memcpy(void* dest, const void* src, size_t n) {
-    char* d = dest;
-    const char* s = src;
-    while (n--) *d++ = *s++;
+    uint8_t* d = dest;
+    const uint8_t* s = src;
+    uint32_t flags;
+
+    if (n >= SIMD_COPY_THRESHOLD && simd_begin(&flags)) {
+        size_t head = (16 - ((uintptr_t)d & 15)) & 15;
+        copy_bytes(d, s, head);
+        d += head;
+        s += head;
+        n -= head;
+        simd_copy_blocks(d, s, n / 64);
+        d += n & ~(size_t)63;
+        s += n & ~(size_t)63;
+        n &= 63;
+        simd_end(flags);
+    }
+
+    if (n >= 16) {
+        // Align the destination; misaligned loads are cheaper than misaligned stores
+        size_t head = (4 - ((uintptr_t)d & 3)) & 3;
+        copy_bytes(d, s, head);
+        d += head;
+        s += head;
+        n -= head;
+        copy_dwords(d, s, n / 4);
+        d += n & ~(size_t)3;
+        s += n & ~(size_t)3;
+        n &= 3;
+    }
+    copy_bytes(d, s, n);
     return dest;
 }
 
 void* memset(void* s, int c, size_t n) {
-    unsigned char* p = s;
-    while (n--) *p++ = (unsigned char)c;
+    uint8_t* p = s;
+    uint32_t pattern = (uint8_t)c * 0x01010101u;
+    uint32_t flags;
+
+    if (n >= SIMD_COPY_THRESHOLD && simd_begin(&flags)) {
+        size_t head = (16 - ((uintptr_t)p & 15)) & 15;
+        n -= head;
+        asm volatile("cld\n\t"
+                     "rep stosb"
+                     : "+D"(p), "+c"(head) : "a"(pattern) : "memory");
+        simd_set_blocks(p, pattern, n / 64);
+        p += n & ~(size_t)63;
+        n &= 63;
+        simd_end(flags);
+    }
+
+    size_t dwords = n / 4;
+    size_t tail = n & 3;
+    asm volatile("cld\n\t"
+                 "rep stosl\n\t"
+                 "mov %3, %%ecx\n\t"
+                 "rep stosb"
+                 : "+D"(p), "+c"(dwords) : "a"(pattern), "r"(tail) : "memory");
     return s;
 }
 
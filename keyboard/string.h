@@ -3,11 +3,15 @@
 
 #include <stddef.h>
 
+// Copies at least this large use the SSE2 path once string_init_simd() succeeds
+#define SIMD_COPY_THRESHOLD 512
+
 size_t strlen(const char* str);
 void* memcpy(void* dest, const void* src, size_t n);
 void* memset(void* s, int c, size_t n);
 int strcmp(const char *s1, const char *s2);
 int strncmp(const char* s1, const char* s2, size_t n);
 char* strncpy(char* dest, const char* src, size_t n);
+int string_init_simd(void);
 
 #endif
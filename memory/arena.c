@@ -0,0 +1,61 @@
+#include "arena.h"
+#include "memory.h"
+
+#define ARENA_ROUND(x) (((x) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static arena_chunk_t* arena_new_chunk(size_t min_bytes) {
+    size_t pages = (ARENA_ROUND(sizeof(arena_chunk_t)) + min_bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (pages < ARENA_CHUNK_PAGES) {
+        pages = ARENA_CHUNK_PAGES;
+    }
+
+    // allocate_pages() hands out zeroed memory, which arena_alloc() passes on
+    arena_chunk_t* chunk = (arena_chunk_t*)allocate_pages(pages);
+    if (!chunk) return NULL;
+    chunk->next = NULL;
+    chunk->size = pages * PAGE_SIZE;
+    chunk->used = ARENA_ROUND(sizeof(arena_chunk_t));
+    heap_charge(KMALLOC_TAG_PROCESS, chunk->size);
+    return chunk;
+}
+
+arena_t* arena_create(void) {
+    arena_chunk_t* chunk = arena_new_chunk(sizeof(arena_t));
+    if (!chunk) return NULL;
+
+    arena_t* arena = (arena_t*)((uint8_t*)chunk + chunk->used);
+    chunk->used += ARENA_ROUND(sizeof(arena_t));
+    arena->chunks = chunk;
+    arena->bytes = 0;
+    arena->pages = chunk->size / PAGE_SIZE;
+    return arena;
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+    size = ARENA_ROUND(size);
+
+    arena_chunk_t* chunk = arena->chunks;
+    if (chunk->size - chunk->used < size) {
+        chunk = arena_new_chunk(size);
+        if (!chunk) return NULL;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->pages += chunk->size / PAGE_SIZE;
+    }
+
+    void* ptr = (uint8_t*)chunk + chunk->used;
+    chunk->used += size;
+    arena->bytes += size;
+    return ptr;
+}
+
+void arena_destroy(arena_t* arena) {
+    // The header lives in the oldest chunk, so read the list head before freeing anything
+    arena_chunk_t* chunk = arena->chunks;
+    while (chunk) {
+        arena_chunk_t* next = chunk->next;
+        heap_uncharge(KMALLOC_TAG_PROCESS, chunk->size);
+        free_pages(chunk);
+        chunk = next;
+    }
+}
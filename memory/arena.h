@@ -0,0 +1,29 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ARENA_CHUNK_PAGES 2     // default chunk size: a PCB plus its kernel stack
+#define ARENA_ALIGN 16
+
+// Chunks are page blocks from the buddy allocator; this header sits at the start of each
+typedef struct arena_chunk {
+    struct arena_chunk* next;
+    size_t size;            // bytes in the chunk, header included
+    size_t used;            // bump offset from the start of the chunk
+} arena_chunk_t;
+
+// Bump allocator whose memory is only ever released all at once. The arena
+// header itself lives in its first chunk, so arena_destroy() frees everything.
+typedef struct arena {
+    arena_chunk_t* chunks;  // most recent chunk first; allocations are served from it
+    size_t bytes;           // bytes handed out so far
+    size_t pages;           // pages held across all chunks
+} arena_t;
+
+arena_t* arena_create(void);
+void* arena_alloc(arena_t* arena, size_t size);
+void arena_destroy(arena_t* arena);
+
+#endif
@@ -0,0 +1,136 @@
+#include "compress.h"
+#include "../keyboard/string.h"
+
+// Static rather than on the stack: the page fault task only has 4 KB to work with
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+
+static inline uint32_t read32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t lz_hash(uint32_t value) {
+    return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Writes the continuation bytes of a length that didn't fit its token nibble
+static uint8_t* put_length(uint8_t* op, uint8_t* end, size_t len) {
+    while (len >= 255) {
+        if (op >= end) return NULL;
+        *op++ = 255;
+        len -= 255;
+    }
+    if (op >= end) return NULL;
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+static uint8_t* put_sequence(uint8_t* op, uint8_t* end, const uint8_t* literals, size_t lit_len,
+                             uint32_t offset, size_t match_len) {
+    if (op >= end) return NULL;
+    uint8_t* token = op++;
+    *token = (uint8_t)((lit_len >= 15 ? 15 : lit_len) << 4);
+    if (lit_len >= 15 && !(op = put_length(op, end, lit_len - 15))) return NULL;
+
+    if ((size_t)(end - op) < lit_len) return NULL;
+    memcpy(op, literals, lit_len);
+    op += lit_len;
+
+    if (match_len == 0) return op;
+
+    if (end - op < 2) return NULL;
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    match_len -= LZ_MIN_MATCH;
+    *token |= (uint8_t)(match_len >= 15 ? 15 : match_len);
+    if (match_len >= 15 && !(op = put_length(op, end, match_len - 15))) return NULL;
+    return op;
+}
+
+// Returns the compressed size, or 0 if the result would not fit in dst_cap
+size_t lz_compress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_cap) {
+    // Positions are stored + 1 so that zero means empty; inputs are at most 64 KB
+    uint16_t* table = lz_table;
+    memset(table, 0, sizeof(lz_table));
+
+    uint8_t* op = dst;
+    uint8_t* end = dst + dst_cap;
+    size_t anchor = 0;
+    size_t i = 0;
+
+    while (i + LZ_MIN_MATCH <= src_len) {
+        uint32_t sequence = read32(src + i);
+        uint32_t h = lz_hash(sequence);
+        size_t ref = table[h];
+        table[h] = (uint16_t)(i + 1);
+
+        if (ref == 0 || read32(src + ref - 1) != sequence) {
+            i++;
+            continue;
+        }
+        ref--;
+
+        size_t len = LZ_MIN_MATCH;
+        while (i + len < src_len && src[ref + len] == src[i + len]) {
+            len++;
+        }
+
+        op = put_sequence(op, end, src + anchor, i - anchor, (uint32_t)(i - ref), len);
+        if (!op) return 0;
+        i += len;
+        anchor = i;
+    }
+
+    op = put_sequence(op, end, src + anchor, src_len - anchor, 0, 0);
+    if (!op) return 0;
+    return (size_t)(op - dst);
+}
+
+// Returns the decompressed size, or 0 if the stream is malformed
+size_t lz_decompress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_cap) {
+    const uint8_t* ip = src;
+    const uint8_t* ip_end = src + src_len;
+    uint8_t* op = dst;
+    uint8_t* op_end = dst + dst_cap;
+
+    while (ip < ip_end) {
+        uint8_t token = *ip++;
+
+        size_t lit_len = token >> 4;
+        if (lit_len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= ip_end) return 0;
+                b = *ip++;
+                lit_len += b;
+            } while (b == 255);
+        }
+        if ((size_t)(ip_end - ip) < lit_len || (size_t)(op_end - op) < lit_len) return 0;
+        memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        if (ip == ip_end) break;   // the last sequence has no match
+
+        if (ip_end - ip < 2) return 0;
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        size_t match_len = (token & 15);
+        if (match_len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= ip_end) return 0;
+                b = *ip++;
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > (size_t)(op - dst) || (size_t)(op_end - op) < match_len) return 0;
+        // Matches may overlap their own output, so copy forwards a byte at a time
+        const uint8_t* match = op - offset;
+        while (match_len--) {
+            *op++ = *match++;
+        }
+    }
+    return (size_t)(op - dst);
+}
@@ -0,0 +1,17 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Byte oriented LZ77 in the style of an LZ4 block: each sequence is a token
+// (literal count << 4 | match length - 4), the literals, then a 16-bit match
+// offset. Lengths of 15 continue in following bytes of 255. The stream ends
+// with a sequence that carries literals only.
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+
+size_t lz_compress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_cap);
+size_t lz_decompress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_cap);
+
+#endif
@@ -1,109 +1,744 @@
 #include "memory.h"
+#include "slab.h"
+#include "multiboot.h"
+#include "../keyboard/string.h"
+#include "../keyboard/io.h"
 
-#define KERNEL_MEMORY_SIZE (1024 * 1024 * 16)  // 16 MB
-#define PAGE_SIZE 4096
-#define NUM_PAGES (KERNEL_MEMORY_SIZE / PAGE_SIZE)
+#define PAGE_NONE 0xFFFFFFFF
+#define ORDER_NONE 0xFF
 
-static uint8_t kernel_memory[KERNEL_MEMORY_SIZE];
+// Metadata for each page. Only the head page of a block is authoritative;
+// slab blocks additionally mark their tail pages so interior pointers resolve.
+typedef struct page_frame {
+    uint32_t next;      // free list links (page indices), PAGE_NONE terminated
+    uint32_t prev;
+    uint8_t state;      // one of the PAGE_* states from memory.h
+    uint8_t order;      // block order when this page heads a block
+    uint16_t refcount;  // mappings sharing an allocated block (copy-on-write)
+    uint8_t zeroed;     // contents known to be zero, no need to clear on allocation
+} page_frame_t;
 
-// Metadata for each page: 0 = free, 1 = head of allocation, 2 = tail part
-static uint8_t page_table[NUM_PAGES];
+// Indexed by physical frame number; sized from the memory map at boot and
+// placed in the first free stretch of RAM above the kernel image
+static page_frame_t* page_frames = NULL;
+static uint32_t max_pfn = 0;
+static size_t total_page_count = 0;
 
-static size_t last_page_index = 0; 
+static memory_region_t memory_regions[MAX_MEMORY_REGIONS];
+static size_t memory_region_count = 0;
+
+// Physical ranges that must never reach the free lists
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+} reserved_range_t;
+
+static reserved_range_t reserved_ranges[MAX_RESERVED_RANGES];
+static size_t reserved_count = 0;
+
+extern uint8_t kernel_end[];
+
+// Single pages cleared ahead of time by the idle loop, handed out without any zeroing
+static uint32_t zero_pool[ZERO_POOL_SIZE];
+static size_t zero_pool_count = 0;
+
+// One free list per order, each holding the head page index of a free block
+static uint32_t free_lists[MAX_ORDER + 1];
+static size_t free_page_count = 0;
+static size_t peak_used_pages = 0;
+
+static heap_tag_stats_t heap_stats[KMALLOC_TAG_COUNT];
+static size_t heap_live_bytes = 0;
+static size_t heap_peak_bytes = 0;
+
+static const char* heap_tag_names[KMALLOC_TAG_COUNT] = {
+    "generic", "process", "fs", "syscall", "driver", "swap"
+};
+
+// Frees memory by pushing cold pages out (see swap.c); returns pages freed
+static size_t (*reclaim_hook)(size_t pages) = NULL;
+static int reclaiming = 0;
 
 extern void debug_print(const char* messe);
+extern void debug_int(uint32_t val);
 extern void print_to_screen(const char* message);
+extern void int_to_hex(uint32_t num, char *buffer);
+extern void int_to_dec(uint32_t num, char *buffer);
 
-void memory_init(uint32_t multiboot_info) {
-    (void)multiboot_info;
+static inline void* frame_address(uint32_t index) {
+    return (void*)(index * PAGE_SIZE);
+}
+
+static inline uint32_t page_index(void* addr) {
+    return (uint32_t)addr / PAGE_SIZE;
+}
 
-    for (uint32_t i = 0; i < KERNEL_MEMORY_SIZE; i++) {
-        kernel_memory[i] = 0;
+static void free_list_push(uint32_t index, uint8_t order) {
+    page_frame_t* frame = &page_frames[index];
+    frame->state = PAGE_FREE;
+    frame->order = order;
+    frame->prev = PAGE_NONE;
+    frame->next = free_lists[order];
+    if (free_lists[order] != PAGE_NONE) {
+        page_frames[free_lists[order]].prev = index;
     }
+    free_lists[order] = index;
+}
 
-    for (size_t i = 0; i < NUM_PAGES; ++i) {
-        page_table[i] = 0;
+static void free_list_remove(uint32_t index) {
+    page_frame_t* frame = &page_frames[index];
+    if (frame->prev != PAGE_NONE) {
+        page_frames[frame->prev].next = frame->next;
+    } else {
+        free_lists[frame->order] = frame->next;
+    }
+    if (frame->next != PAGE_NONE) {
+        page_frames[frame->next].prev = frame->prev;
     }
+    frame->order = ORDER_NONE;
+}
 
-    last_page_index = 0;
-    debug_print("DEBUG: Kernel memory initialized.");
+// Hand a run of pages to the buddy lists as the largest naturally aligned blocks that fit
+static void buddy_add_range(uint32_t start, uint32_t count) {
+    while (count > 0) {
+        uint8_t order = MAX_ORDER;
+        while (order > 0 && (((start & ((1u << order) - 1)) != 0) || (1u << order) > count)) {
+            order--;
+        }
+        free_list_push(start, order);
+        free_page_count += (size_t)1 << order;
+        start += 1u << order;
+        count -= 1u << order;
+    }
 }
 
-void* allocate_pages(size_t num_pages) {
-    size_t start = last_page_index;
-    size_t count = 0;
-    size_t found_start = (size_t)-1;
+static void zero_pages(void* addr, size_t num_pages) {
+    memset(addr, 0, num_pages * PAGE_SIZE);
+}
+
+static void reserve_range(uint32_t start, uint32_t end) {
+    if (reserved_count >= MAX_RESERVED_RANGES || end <= start) return;
+    reserved_ranges[reserved_count].start = start & PAGE_MASK;
+    reserved_ranges[reserved_count].end = (end + PAGE_SIZE - 1) & PAGE_MASK;
+    reserved_count++;
+}
+
+static void add_region(uint64_t base, uint64_t length, uint32_t type) {
+    if (memory_region_count >= MAX_MEMORY_REGIONS || length == 0) return;
+    if (base >= MEMORY_LIMIT) return;
+    if (base + length > MEMORY_LIMIT) {
+        length = MEMORY_LIMIT - base;
+    }
+    memory_regions[memory_region_count].base = (uint32_t)base;
+    memory_regions[memory_region_count].length = (uint32_t)length;
+    memory_regions[memory_region_count].type = type;
+    memory_region_count++;
+}
+
+static void parse_memory_map(multiboot_info_t* mbi) {
+    memory_region_count = 0;
+
+    if (mbi != NULL && (mbi->flags & MULTIBOOT_INFO_MMAP)) {
+        uint32_t addr = mbi->mmap_addr;
+        uint32_t end = mbi->mmap_addr + mbi->mmap_length;
+        while (addr < end) {
+            multiboot_mmap_entry_t* entry = (multiboot_mmap_entry_t*)addr;
+            add_region(entry->base_addr, entry->length, entry->type);
+            addr += entry->size + sizeof(entry->size);
+        }
+    } else if (mbi != NULL && (mbi->flags & MULTIBOOT_INFO_MEMORY)) {
+        add_region(0, (uint64_t)mbi->mem_lower * 1024, MULTIBOOT_MEMORY_AVAILABLE);
+        add_region(0x100000, (uint64_t)mbi->mem_upper * 1024, MULTIBOOT_MEMORY_AVAILABLE);
+    } else {
+        debug_print("DEBUG: No memory information from the boot loader, assuming defaults.");
+        add_region(0x100000, DEFAULT_MEMORY_SIZE - 0x100000, MULTIBOOT_MEMORY_AVAILABLE);
+    }
+}
+
+static uint32_t overlapping_reserved_end(uint32_t start, uint32_t end) {
+    for (size_t i = 0; i < reserved_count; i++) {
+        if (start < reserved_ranges[i].end && reserved_ranges[i].start < end) {
+            return reserved_ranges[i].end;
+        }
+    }
+    return 0;
+}
 
-    for (size_t i = 0; i < NUM_PAGES; ++i) {
-        size_t index = (start + i) % NUM_PAGES;
+// First page-aligned stretch of available RAM that avoids every reserved range
+static uint32_t find_free_range(uint32_t size) {
+    for (size_t i = 0; i < memory_region_count; i++) {
+        if (memory_regions[i].type != MULTIBOOT_MEMORY_AVAILABLE) continue;
 
-        if (page_table[index] == 0) {
-            if (found_start == (size_t)-1) {
-                found_start = index;
+        uint32_t start = (memory_regions[i].base + PAGE_SIZE - 1) & PAGE_MASK;
+        uint32_t end = (memory_regions[i].base + memory_regions[i].length) & PAGE_MASK;
+        while (start + size > start && start + size <= end) {
+            uint32_t blocked_until = overlapping_reserved_end(start, start + size);
+            if (blocked_until == 0) {
+                return start;
             }
-            count++;
-            if (count == num_pages) {
-                page_table[found_start] = 1; 
-                for (size_t j = 1; j < num_pages; ++j) {
-                    page_table[(found_start + j) % NUM_PAGES] = 2;  
-                }
-
-                last_page_index = (found_start + num_pages) % NUM_PAGES;
-                return &kernel_memory[found_start * PAGE_SIZE];
+            start = blocked_until;
+        }
+    }
+    return 0;
+}
+
+// Gives [start, end) to the buddy allocator minus anything reserved inside it
+static void add_usable_range(uint32_t start, uint32_t end) {
+    while (start < end) {
+        // Nearest reserved range overlapping what is left of the region
+        uint32_t cut_start = end;
+        uint32_t cut_end = end;
+        for (size_t i = 0; i < reserved_count; i++) {
+            if (reserved_ranges[i].start >= end || reserved_ranges[i].end <= start) continue;
+
+            uint32_t overlap = reserved_ranges[i].start > start ? reserved_ranges[i].start : start;
+            if (overlap < cut_start || (overlap == cut_start && reserved_ranges[i].end > cut_end)) {
+                cut_start = overlap;
+                cut_end = reserved_ranges[i].end;
             }
-        } else {
-            count = 0;
-            found_start = (size_t)-1;
         }
+        if (cut_start > start) {
+            buddy_add_range(page_index((void*)start), (cut_start - start) / PAGE_SIZE);
+            total_page_count += (cut_start - start) / PAGE_SIZE;
+        }
+        start = cut_end;
     }
+}
+
+void memory_init(uint32_t multiboot_info) {
+    multiboot_info_t* mbi = (multiboot_info_t*)multiboot_info;
+
+    parse_memory_map(mbi);
 
-    return NULL; 
+    // Low memory (BIOS data, VGA, boot loader structures) and the kernel image are off limits
+    reserved_count = 0;
+    reserve_range(0, (uint32_t)kernel_end);
+    if (mbi != NULL) {
+        reserve_range(multiboot_info, multiboot_info + sizeof(multiboot_info_t));
+        if (mbi->flags & MULTIBOOT_INFO_MMAP) {
+            reserve_range(mbi->mmap_addr, mbi->mmap_addr + mbi->mmap_length);
+        }
+        if (mbi->flags & MULTIBOOT_INFO_MODS) {
+            multiboot_module_t* mods = (multiboot_module_t*)mbi->mods_addr;
+            reserve_range(mbi->mods_addr, mbi->mods_addr + mbi->mods_count * sizeof(multiboot_module_t));
+            for (uint32_t i = 0; i < mbi->mods_count; i++) {
+                reserve_range(mods[i].mod_start, mods[i].mod_end);
+            }
+        }
+    }
+
+    max_pfn = 0;
+    for (size_t i = 0; i < memory_region_count; i++) {
+        if (memory_regions[i].type != MULTIBOOT_MEMORY_AVAILABLE) continue;
+        uint32_t end_pfn = (memory_regions[i].base + memory_regions[i].length) / PAGE_SIZE;
+        if (end_pfn > max_pfn) {
+            max_pfn = end_pfn;
+        }
+    }
+
+    uint32_t frames_size = (max_pfn * sizeof(page_frame_t) + PAGE_SIZE - 1) & PAGE_MASK;
+    uint32_t frames_addr = find_free_range(frames_size);
+    if (frames_addr == 0) {
+        debug_print("DEBUG: No room for the page frame array!");
+        while (1) { asm volatile("cli; hlt"); }
+    }
+    reserve_range(frames_addr, frames_addr + frames_size);
+    page_frames = (page_frame_t*)frames_addr;
+
+    // RAM contents are unknown, so nothing is marked zeroed; pages are only
+    // cleared when allocate_pages() hands them out
+    for (uint32_t i = 0; i < max_pfn; ++i) {
+        page_frames[i].state = PAGE_RESERVED;
+        page_frames[i].order = ORDER_NONE;
+        page_frames[i].next = PAGE_NONE;
+        page_frames[i].prev = PAGE_NONE;
+        page_frames[i].refcount = 0;
+        page_frames[i].zeroed = 0;
+    }
+    for (int order = 0; order <= MAX_ORDER; order++) {
+        free_lists[order] = PAGE_NONE;
+    }
+    free_page_count = 0;
+    total_page_count = 0;
+    zero_pool_count = 0;
+
+    for (size_t i = 0; i < memory_region_count; i++) {
+        if (memory_regions[i].type != MULTIBOOT_MEMORY_AVAILABLE) continue;
+        uint32_t start = (memory_regions[i].base + PAGE_SIZE - 1) & PAGE_MASK;
+        uint32_t end = (memory_regions[i].base + memory_regions[i].length) & PAGE_MASK;
+        add_usable_range(start, end);
+    }
+
+    slab_init();
+    debug_print("DEBUG: Kernel memory initialized, usable pages:");
+    debug_int((uint32_t)total_page_count);
 }
 
-void* kmalloc(size_t size) {
-    size_t total_size = size + sizeof(memory_block_t);
-    size_t num_pages = (total_size + PAGE_SIZE - 1) / PAGE_SIZE;
+uint32_t memory_end(void) {
+    return max_pfn * PAGE_SIZE;
+}
+
+static void print_hex(uint32_t value) {
+    char buffer[11];
+    int_to_hex(value, buffer);
+    print_to_screen(buffer);
+}
+
+static void print_dec(uint32_t value) {
+    char buffer[16];
+    int_to_dec(value, buffer);
+    print_to_screen(buffer);
+}
 
-    void* mem = allocate_pages(num_pages);
+void memory_print_map(void) {
+    print_to_screen("Physical memory map:\n");
+    for (size_t i = 0; i < memory_region_count; i++) {
+        print_to_screen("  ");
+        print_hex(memory_regions[i].base);
+        print_to_screen(" - ");
+        print_hex(memory_regions[i].base + memory_regions[i].length - 1);
+        print_to_screen(memory_regions[i].type == MULTIBOOT_MEMORY_AVAILABLE ? "  available  " : "  reserved   ");
+        print_dec(memory_regions[i].length / 1024);
+        print_to_screen(" KB\n");
+    }
+    print_to_screen("Kernel image ends at ");
+    print_hex((uint32_t)kernel_end);
+    print_to_screen(", page frames at ");
+    print_hex((uint32_t)page_frames);
+    print_to_screen("\nManaged pages: ");
+    print_dec((uint32_t)total_page_count);
+    print_to_screen(", free pages: ");
+    print_dec((uint32_t)free_page_count);
+    print_to_screen("\n");
+}
+
+static uint8_t order_for_pages(size_t num_pages) {
+    uint8_t order = 0;
+    while (((size_t)1 << order) < num_pages) {
+        order++;
+    }
+    return order;
+}
+
+static void* claim_block(uint8_t order, uint8_t head_state) {
+    if (order > MAX_ORDER) return NULL;
+
+    uint8_t current = order;
+    while (current <= MAX_ORDER && free_lists[current] == PAGE_NONE) {
+        current++;
+    }
+    if (current > MAX_ORDER) return NULL;
+
+    uint32_t index = free_lists[current];
+    free_list_remove(index);
+
+    // Split down to the requested order, returning upper halves to their lists
+    while (current > order) {
+        current--;
+        free_list_push(index + (1u << current), current);
+    }
+
+    page_frames[index].state = head_state;
+    page_frames[index].order = order;
+    page_frames[index].refcount = 1;
+    free_page_count -= (size_t)1 << order;
+    if (total_page_count - free_page_count > peak_used_pages) {
+        peak_used_pages = total_page_count - free_page_count;
+    }
+    return frame_address(index);
+}
+
+// Page blocks are handed out zeroed; only pages dirtied since boot need clearing
+static void* claim_zeroed_block(uint8_t order) {
+    if (order == 0 && zero_pool_count > 0) {
+        uint32_t index = zero_pool[--zero_pool_count];
+        page_frames[index].zeroed = 0;
+        return frame_address(index);
+    }
+
+    uint8_t* mem = (uint8_t*)claim_block(order, PAGE_HEAD);
     if (!mem) return NULL;
 
-    memory_block_t* block = (memory_block_t*)mem;
-    block->size = size;
-    block->is_free = 0;
+    uint32_t index = page_index(mem);
+    for (uint32_t i = 0; i < (1u << order); i++) {
+        if (!page_frames[index + i].zeroed) {
+            zero_pages(mem + (size_t)i * PAGE_SIZE, 1);
+        }
+        page_frames[index + i].zeroed = 0;
+    }
+    return mem;
+}
+
+void memory_set_reclaim_hook(size_t (*hook)(size_t pages)) {
+    reclaim_hook = hook;
+}
+
+// The hook allocates itself (compressed buffers), so it must not recurse
+static size_t run_reclaim(size_t pages) {
+    if (reclaim_hook == NULL || reclaiming) return 0;
+    reclaiming = 1;
+    size_t freed = reclaim_hook(pages < RECLAIM_BATCH ? RECLAIM_BATCH : pages);
+    reclaiming = 0;
+    return freed;
+}
+
+// The public entry points below run with interrupts off: processes can be
+// preempted anywhere, and the allocator has no other locking.
+void* allocate_pages_order(uint8_t order) {
+    uint32_t flags = irq_save();
+    void* mem = claim_zeroed_block(order);
+    if (!mem && run_reclaim((size_t)1 << order)) {
+        mem = claim_zeroed_block(order);
+    }
+    irq_restore(flags);
+    return mem;
+}
+
+void* allocate_pages(size_t num_pages) {
+    if (num_pages == 0) return NULL;
+    return allocate_pages_order(order_for_pages(num_pages));
+}
+
+// Called from idle loops: tops up the pool of pre-zeroed pages one page at a
+// time. Returns 1 if it did any work, 0 once the pool is full or memory is short.
+static int idle_refill(void) {
+    if (free_page_count < RECLAIM_LOW_PAGES && run_reclaim(RECLAIM_BATCH)) {
+        return 1;
+    }
+    if (zero_pool_count >= ZERO_POOL_SIZE || free_page_count <= ZERO_POOL_RESERVE) {
+        return 0;
+    }
+
+    uint8_t* mem = (uint8_t*)claim_block(0, PAGE_HEAD);
+    if (!mem) return 0;
+
+    uint32_t index = page_index(mem);
+    if (!page_frames[index].zeroed) {
+        zero_pages(mem, 1);
+        page_frames[index].zeroed = 1;
+    }
+    zero_pool[zero_pool_count++] = index;
+    return 1;
+}
+
+int memory_idle_refill(void) {
+    uint32_t flags = irq_save();
+    int worked = idle_refill();
+    irq_restore(flags);
+    return worked;
+}
+
+void* allocate_slab_pages(size_t num_pages) {
+    uint8_t order = order_for_pages(num_pages);
+    uint32_t flags = irq_save();
+    uint8_t* mem = (uint8_t*)claim_block(order, PAGE_SLAB);
+    if (!mem && run_reclaim((size_t)1 << order)) {
+        mem = (uint8_t*)claim_block(order, PAGE_SLAB);
+    }
+    if (mem) {
+        uint32_t index = page_index(mem);
+        page_frames[index].zeroed = 0;
+        for (uint32_t i = 1; i < (1u << order); i++) {
+            page_frames[index + i].state = PAGE_SLAB_TAIL;
+            page_frames[index + i].order = order;
+            page_frames[index + i].zeroed = 0;
+        }
+    }
+    irq_restore(flags);
+    return mem;
+}
+
+int is_slab_page(void* addr) {
+    if (page_index(addr) >= max_pfn) {
+        return 0;
+    }
+    uint8_t state = page_frames[page_index(addr)].state;
+    return state == PAGE_SLAB || state == PAGE_SLAB_TAIL;
+}
+
+void* slab_page_head(void* addr) {
+    uint32_t index = page_index(addr);
+    index &= ~((1u << page_frames[index].order) - 1);
+    return frame_address(index);
+}
+
+void page_get(void* addr) {
+    uint32_t flags = irq_save();
+    page_frames[page_index(addr)].refcount++;
+    irq_restore(flags);
+}
+
+// Drops one reference to a page block and frees it once nobody maps it anymore
+void page_put(void* addr) {
+    uint32_t flags = irq_save();
+    page_frame_t* frame = &page_frames[page_index(addr)];
+    if (frame->refcount > 1) {
+        frame->refcount--;
+    } else {
+        free_pages(addr);
+    }
+    irq_restore(flags);
+}
 
-    return (void*)((uint8_t*)block + sizeof(memory_block_t));
+uint16_t page_refcount(void* addr) {
+    return page_frames[page_index(addr)].refcount;
+}
+
+static void free_block(void* addr) {
+    uint32_t index = page_index(addr);
+    if (index >= max_pfn) return;
+    uint8_t state = page_frames[index].state;
+    if (state != PAGE_HEAD && state != PAGE_SLAB) {
+        return;
+    }
+
+    uint8_t order = page_frames[index].order;
+    if (state == PAGE_SLAB) {
+        for (uint32_t i = 1; i < (1u << order); i++) {
+            page_frames[index + i].state = PAGE_FREE;
+            page_frames[index + i].order = ORDER_NONE;
+        }
+    }
+    page_frames[index].state = PAGE_FREE;
+    page_frames[index].refcount = 0;
+    free_page_count += (size_t)1 << order;
+
+    // Merge with the buddy for as long as it is a free block of the same order
+    while (order < MAX_ORDER) {
+        uint32_t buddy = index ^ (1u << order);
+        if (buddy >= max_pfn) break;
+        page_frame_t* frame = &page_frames[buddy];
+        if (frame->state != PAGE_FREE || frame->order != order) break;
+
+        free_list_remove(buddy);
+        if (buddy < index) {
+            page_frames[index].order = ORDER_NONE;
+            index = buddy;
+        } else {
+            page_frames[buddy].order = ORDER_NONE;
+        }
+        order++;
+    }
+    free_list_push(index, order);
+}
+
+void free_pages(void* addr) {
+    uint32_t flags = irq_save();
+    free_block(addr);
+    irq_restore(flags);
+}
+
+void heap_charge(uint8_t tag, size_t bytes) {
+    uint32_t flags = irq_save();
+    heap_tag_stats_t* stats = &heap_stats[tag < KMALLOC_TAG_COUNT ? tag : KMALLOC_TAG_GENERIC];
+    stats->live_bytes += bytes;
+    stats->live_allocs++;
+    stats->total_allocs++;
+    if (stats->live_bytes > stats->peak_bytes) {
+        stats->peak_bytes = stats->live_bytes;
+    }
+    heap_live_bytes += bytes;
+    if (heap_live_bytes > heap_peak_bytes) {
+        heap_peak_bytes = heap_live_bytes;
+    }
+    irq_restore(flags);
+}
+
+void heap_uncharge(uint8_t tag, size_t bytes) {
+    uint32_t flags = irq_save();
+    heap_tag_stats_t* stats = &heap_stats[tag < KMALLOC_TAG_COUNT ? tag : KMALLOC_TAG_GENERIC];
+    stats->live_bytes -= bytes;
+    stats->live_allocs--;
+    heap_live_bytes -= bytes;
+    irq_restore(flags);
+}
+
+void* kmalloc(size_t size) {
+    return kmalloc_tagged(size, KMALLOC_TAG_GENERIC);
+}
+
+// Small requests come from the slab caches; only large ones cost whole pages
+void* kmalloc_tagged(size_t size, uint8_t tag) {
+    size_t total_size = size + sizeof(memory_block_t);
+    uint32_t flags = irq_save();
+    void* mem;
+    if (total_size <= SLAB_MAX_SIZE) {
+        mem = slab_alloc(total_size);
+    } else {
+        mem = allocate_pages((total_size + PAGE_SIZE - 1) / PAGE_SIZE);
+    }
+    if (mem) {
+        memory_block_t* block = (memory_block_t*)mem;
+        block->size = size;
+        block->tag = tag;
+        block->is_free = 0;
+        heap_charge(tag, size);
+        mem = (uint8_t*)block + sizeof(memory_block_t);
+    }
+    irq_restore(flags);
+    return mem;
 }
 
 void kfree(void* ptr) {
     if (ptr == NULL) return;
 
     memory_block_t* block = (memory_block_t*)((uint8_t*)ptr - sizeof(memory_block_t));
+    uint32_t flags = irq_save();
     block->is_free = 1;
+    heap_uncharge(block->tag, block->size);
 
-    uintptr_t offset = (uintptr_t)((uint8_t*)block - kernel_memory);
-    size_t start_page = offset / PAGE_SIZE;
-
-    if (page_table[start_page] == 1) {
-        page_table[start_page] = 0;
-        size_t i = start_page + 1;
-        while (i < NUM_PAGES && page_table[i] == 2) {
-            page_table[i] = 0;
-            i++;
-        }
+    if (is_slab_page(block)) {
+        slab_free(block);
+    } else {
+        free_pages(block);
     }
+    irq_restore(flags);
 
     debug_print("DEBUG: Memory freed");
 }
 
-void copy_page_tables(uint32_t parent_cr3, uint32_t child_cr3) {
-    copy_memory((void*)child_cr3, (void*)parent_cr3, PAGE_SIZE);
+static void out_dec(void (*out)(const char*), uint32_t value) {
+    char buffer[16];
+    int_to_dec(value, buffer);
+    out(buffer);
+}
+
+void memory_print_stats(void (*out)(const char*)) {
+    out("Pages: ");
+    out_dec(out, (uint32_t)total_page_count);
+    out(" managed, ");
+    out_dec(out, (uint32_t)(total_page_count - free_page_count));
+    out(" in use, peak ");
+    out_dec(out, (uint32_t)peak_used_pages);
+    out(", ");
+    out_dec(out, (uint32_t)zero_pool_count);
+    out(" pre-zeroed\n");
+
+    out("Heap: ");
+    out_dec(out, (uint32_t)heap_live_bytes);
+    out(" bytes live, peak ");
+    out_dec(out, (uint32_t)heap_peak_bytes);
+    out("\n");
+    for (size_t i = 0; i < KMALLOC_TAG_COUNT; i++) {
+        out("  ");
+        out(heap_tag_names[i]);
+        out(": ");
+        out_dec(out, (uint32_t)heap_stats[i].live_bytes);
+        out(" bytes in ");
+        out_dec(out, heap_stats[i].live_allocs);
+        out(" allocs, peak ");
+        out_dec(out, (uint32_t)heap_stats[i].peak_bytes);
+        out(", ");
+        out_dec(out, heap_stats[i].total_allocs);
+        out(" allocs total\n");
+    }
+
+    // Walk the frame array for physically contiguous free runs; adjacent
+    // buddy blocks that could not merge still form one run here
+    uint32_t histogram[FREE_RUN_BUCKETS] = { 0 };
+    uint32_t largest_run = 0;
+    uint32_t run = 0;
+    uint32_t runs = 0;
+    uint32_t index = 0;
+    for (;;) {
+        page_frame_t* frame = index < max_pfn ? &page_frames[index] : NULL;
+        if (frame && frame->state == PAGE_FREE && frame->order != ORDER_NONE) {
+            run += 1u << frame->order;
+            index += 1u << frame->order;
+            continue;
+        }
+        if (run > 0) {
+            uint32_t bucket = 31 - __builtin_clz(run);
+            histogram[bucket < FREE_RUN_BUCKETS ? bucket : FREE_RUN_BUCKETS - 1]++;
+            if (run > largest_run) largest_run = run;
+            runs++;
+            run = 0;
+        }
+        if (!frame) break;
+        index += frame->state == PAGE_HEAD ? (1u << frame->order) : 1;
+    }
+
+    out("Free memory: ");
+    out_dec(out, (uint32_t)free_page_count);
+    out(" pages in ");
+    out_dec(out, runs);
+    out(" runs, largest ");
+    out_dec(out, largest_run);
+    out(" pages, fragmentation ");
+    out_dec(out, free_page_count ? 100 - largest_run * 100 / (uint32_t)free_page_count : 0);
+    out("%\n");
+    for (uint32_t i = 0; i < FREE_RUN_BUCKETS; i++) {
+        if (histogram[i] == 0) continue;
+        out("  ");
+        out_dec(out, 1u << i);
+        out("+ pages: ");
+        out_dec(out, histogram[i]);
+        out(" runs\n");
+    }
 }
 
 void copy_memory(void* dest, void* src, size_t size) {
-    uint8_t* d = (uint8_t*)dest;
-    uint8_t* s = (uint8_t*)src;
+    memcpy(dest, src, size);
+}
+
+#define BENCH_PAGES 16
+#define BENCH_BYTES (1u << 20)   // bytes moved per measurement
 
+static void bench_byte_copy(uint8_t* dest, const uint8_t* src, size_t size) {
+    volatile uint8_t* d = dest;
     for (size_t i = 0; i < size; i++) {
-        d[i] = s[i];
+        d[i] = src[i];
     }
 }
+
+// Prints bytes per cycle with two decimals
+static void bench_print_rate(uint32_t cycles) {
+    char buffer[16];
+    uint32_t rate = cycles ? BENCH_BYTES * 100 / cycles : 0;
+    int_to_dec(rate / 100, buffer);
+    print_to_screen("  ");
+    print_to_screen(buffer);
+    print_to_screen(".");
+    int_to_dec(rate % 100, buffer);
+    if (rate % 100 < 10) print_to_screen("0");
+    print_to_screen(buffer);
+}
+
+void memory_bench(void) {
+    static const uint32_t sizes[] = { 64, 256, 1024, 4096, 16384, 65536 };
+    uint8_t* src = (uint8_t*)allocate_pages(BENCH_PAGES);
+    uint8_t* dest = (uint8_t*)allocate_pages(BENCH_PAGES);
+    if (!src || !dest) {
+        if (src) free_pages(src);
+        if (dest) free_pages(dest);
+        print_to_screen("bench mem: out of memory\n");
+        return;
+    }
+
+    print_to_screen("Bytes per cycle (byte loop / memcpy / memset):\n");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint32_t size = sizes[i];
+        uint32_t rounds = BENCH_BYTES / size;
+        uint64_t start;
+
+        print_dec(size);
+        print_to_screen(" B:");
+
+        start = rdtsc();
+        for (uint32_t r = 0; r < rounds; r++) bench_byte_copy(dest, src, size);
+        bench_print_rate((uint32_t)(rdtsc() - start));
+
+        start = rdtsc();
+        for (uint32_t r = 0; r < rounds; r++) memcpy(dest, src, size);
+        bench_print_rate((uint32_t)(rdtsc() - start));
+
+        start = rdtsc();
+        for (uint32_t r = 0; r < rounds; r++) memset(dest, 0, size);
+        bench_print_rate((uint32_t)(rdtsc() - start));
+
+        print_to_screen("\n");
+    }
+
+    free_pages(src);
+    free_pages(dest);
+}
@@ -4,18 +4,85 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#define PAGE_SIZE 4096
+#define PAGE_MASK 0xFFFFF000
+#define MAX_ORDER 12    // largest buddy block is 2^12 pages (16 MB)
+
+// Physical memory above this is left alone: the identity mapped kernel space
+// has to stay below USER_SPACE_START (see paging.h)
+#define MEMORY_LIMIT 0x40000000
+#define DEFAULT_MEMORY_SIZE (32 * 1024 * 1024)  // used when the boot loader reports nothing
+#define MAX_MEMORY_REGIONS 32
+#define MAX_RESERVED_RANGES 32
+
+#define ZERO_POOL_SIZE 32       // pre-zeroed single pages kept ready by the idle loop
+#define ZERO_POOL_RESERVE 256   // stop refilling when free memory drops below this
+#define RECLAIM_LOW_PAGES 128   // the idle loop reclaims while free memory is below this
+#define RECLAIM_BATCH 32        // pages asked of the reclaim hook at a time
+
+// Page states kept in the page frame array
+#define PAGE_FREE      0
+#define PAGE_HEAD      1
+#define PAGE_TAIL      2
+#define PAGE_SLAB      3
+#define PAGE_SLAB_TAIL 4
+#define PAGE_RESERVED  5    // not RAM, or RAM the allocator must not touch
+
+typedef struct memory_region {
+    uint32_t base;
+    uint32_t length;
+    uint32_t type;      // MULTIBOOT_MEMORY_AVAILABLE or a reserved type
+} memory_region_t;
+
+// Owners that heap allocations are charged to, reported by 'mem stats'
+#define KMALLOC_TAG_GENERIC 0
+#define KMALLOC_TAG_PROCESS 1
+#define KMALLOC_TAG_FS      2
+#define KMALLOC_TAG_SYSCALL 3
+#define KMALLOC_TAG_DRIVER  4
+#define KMALLOC_TAG_SWAP    5
+#define KMALLOC_TAG_COUNT   6
+
+#define FREE_RUN_BUCKETS 20     // histogram of free runs by log2 of their length in pages
+
+// Precedes every kmalloc() allocation, slab backed or not
 typedef struct memory_block {
     size_t size;
+    uint8_t tag;
     uint8_t is_free;
 } memory_block_t;
 
+typedef struct heap_tag_stats {
+    size_t live_bytes;
+    size_t peak_bytes;
+    uint32_t live_allocs;
+    uint32_t total_allocs;
+} heap_tag_stats_t;
+
 void memory_init(uint32_t multiboot_info);
+uint32_t memory_end(void);
+void memory_print_map(void);
 
 void* kmalloc(size_t size);
+void* kmalloc_tagged(size_t size, uint8_t tag);
+void kfree(void* ptr);
+void heap_charge(uint8_t tag, size_t bytes);
+void heap_uncharge(uint8_t tag, size_t bytes);
+void memory_print_stats(void (*out)(const char*));
 
 void* allocate_pages(size_t num_pages);
+void* allocate_pages_order(uint8_t order);
+void* allocate_slab_pages(size_t num_pages);
+int memory_idle_refill(void);
+void memory_set_reclaim_hook(size_t (*hook)(size_t pages));
+void free_pages(void* addr);
+void page_get(void* addr);
+void page_put(void* addr);
+uint16_t page_refcount(void* addr);
+int is_slab_page(void* addr);
+void* slab_page_head(void* addr);
 
-void copy_page_tables(uint32_t parent_cr3, uint32_t child_cr3);
 void copy_memory(void* dest, void* src, size_t size);
+void memory_bench(void);
 
-#endif
\ No newline at end of file
+#endif
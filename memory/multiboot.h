@@ -0,0 +1,40 @@
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include <stdint.h>
+
+#define MULTIBOOT_INFO_MEMORY  0x001   // mem_lower / mem_upper are valid
+#define MULTIBOOT_INFO_MODS    0x008   // mods_count / mods_addr are valid
+#define MULTIBOOT_INFO_MMAP    0x040   // mmap_length / mmap_addr are valid
+
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+
+typedef struct multiboot_info {
+    uint32_t flags;
+    uint32_t mem_lower;     // KB below 1 MB
+    uint32_t mem_upper;     // KB above 1 MB
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t syms[4];
+    uint32_t mmap_length;
+    uint32_t mmap_addr;
+} __attribute__((packed)) multiboot_info_t;
+
+// 'size' does not count itself, so entries are walked by size + 4
+typedef struct multiboot_mmap_entry {
+    uint32_t size;
+    uint64_t base_addr;
+    uint64_t length;
+    uint32_t type;
+} __attribute__((packed)) multiboot_mmap_entry_t;
+
+typedef struct multiboot_module {
+    uint32_t mod_start;
+    uint32_t mod_end;
+    uint32_t string;
+    uint32_t reserved;
+} __attribute__((packed)) multiboot_module_t;
+
+#endif
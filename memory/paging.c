@@ -0,0 +1,302 @@
+#include "paging.h"
+#include "memory.h"
+#include "swap.h"
+#include "../keyboard/gdt.h"
+#include "../keyboard/io.h"
+#include "../keyboard/string.h"
+
+uint32_t kernel_directory = 0;
+
+static uint32_t global_flag = 0;
+
+extern uint8_t kernel_end[];
+
+extern void debug_print(const char* messe);
+extern void debug_int(uint32_t val);
+extern void process_fault_exit(void);
+
+void paging_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (edx & (1 << 13)) {
+        global_flag = PTE_GLOBAL;
+    }
+
+    kernel_directory = (uint32_t)allocate_pages(1);
+
+    // Identity map low memory, the kernel image and all RAM the page allocator manages
+    uint32_t identity_end = memory_end() > (uint32_t)kernel_end ? memory_end() : (uint32_t)kernel_end;
+    identity_end = (identity_end + LARGE_PAGE_SIZE - 1) & ~(LARGE_PAGE_SIZE - 1);
+    uint32_t* pd = (uint32_t*)kernel_directory;
+    for (uint32_t addr = 0; addr < identity_end; addr += LARGE_PAGE_SIZE) {
+        pd[PDE_INDEX(addr)] = addr | PTE_PRESENT | PTE_WRITE | PTE_LARGE | global_flag;
+    }
+
+    uint32_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_PSE;
+    if (global_flag) {
+        cr4 |= CR4_PGE;
+    }
+    asm volatile("mov %0, %%cr4" : : "r"(cr4));
+
+    load_cr3(kernel_directory);
+
+    uint32_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 |= CR0_PG | CR0_WP;
+    asm volatile("mov %0, %%cr0" : : "r"(cr0));
+
+    debug_print("DEBUG: Paging enabled, identity mapped up to:");
+    debug_int(identity_end);
+}
+
+uint32_t paging_create_directory(void) {
+    uint32_t dir = (uint32_t)allocate_pages(1);
+    if (dir == 0) return 0;
+
+    uint32_t* pd = (uint32_t*)dir;
+    uint32_t* kpd = (uint32_t*)kernel_directory;
+    for (int i = 0; i < PAGE_ENTRIES; i++) {
+        pd[i] = (i < PDE_INDEX(USER_SPACE_START)) ? kpd[i] : 0;
+    }
+    return dir;
+}
+
+// Releases the user half of an address space: every mapped frame, every page table and the directory itself
+void paging_free_directory(uint32_t dir) {
+    if (dir == 0 || dir == kernel_directory) return;
+
+    uint32_t* pd = (uint32_t*)dir;
+    for (int i = PDE_INDEX(USER_SPACE_START); i < PAGE_ENTRIES; i++) {
+        if (!(pd[i] & PTE_PRESENT)) continue;
+
+        uint32_t* pt = (uint32_t*)(pd[i] & PTE_FRAME_MASK);
+        for (int j = 0; j < PAGE_ENTRIES; j++) {
+            if (pt[j] & PTE_PRESENT) {
+                page_put((void*)(pt[j] & PTE_FRAME_MASK));
+            } else if (pt[j] & PTE_SWAPPED) {
+                swap_release(pt[j]);
+            }
+        }
+        free_pages(pt);
+    }
+    free_pages((void*)dir);
+}
+
+void paging_switch(uint32_t dir) {
+    if (read_cr3() != dir) {
+        load_cr3(dir);
+        kernel_tss.cr3 = dir;
+    }
+}
+
+uint32_t* paging_get_pte(uint32_t dir, uint32_t virt, int create) {
+    uint32_t* pd = (uint32_t*)dir;
+    uint32_t pde = pd[PDE_INDEX(virt)];
+
+    if (!(pde & PTE_PRESENT)) {
+        if (!create) return NULL;
+        uint32_t table = (uint32_t)allocate_pages(1);
+        if (table == 0) return NULL;
+        // Permissions are decided per page, so the directory entry stays permissive
+        pd[PDE_INDEX(virt)] = table | PTE_PRESENT | PTE_WRITE | PTE_USER;
+        pde = pd[PDE_INDEX(virt)];
+    } else if (pde & PTE_LARGE) {
+        return NULL;
+    }
+
+    uint32_t* pt = (uint32_t*)(pde & PTE_FRAME_MASK);
+    return &pt[PTE_INDEX(virt)];
+}
+
+static void flush_if_current(uint32_t dir, uint32_t virt) {
+    if (read_cr3() == dir) {
+        invlpg(virt);
+    }
+}
+
+int paging_map(uint32_t dir, uint32_t virt, uint32_t phys, uint32_t flags) {
+    uint32_t* pte = paging_get_pte(dir, virt, 1);
+    if (pte == NULL) return -1;
+
+    *pte = (phys & PTE_FRAME_MASK) | (flags & PTE_FLAGS_MASK) | PTE_PRESENT;
+    flush_if_current(dir, virt);
+    return 0;
+}
+
+// Returns the frame that was mapped at virt, or 0 if nothing was
+uint32_t paging_unmap(uint32_t dir, uint32_t virt) {
+    uint32_t* pte = paging_get_pte(dir, virt, 0);
+    if (pte == NULL) return 0;
+    if (!(*pte & PTE_PRESENT)) {
+        if (*pte & PTE_SWAPPED) {
+            swap_release(*pte);
+            *pte = 0;
+        }
+        return 0;
+    }
+
+    uint32_t frame = *pte & PTE_FRAME_MASK;
+    *pte = 0;
+    flush_if_current(dir, virt);
+    return frame;
+}
+
+int paging_protect(uint32_t dir, uint32_t virt, uint32_t flags) {
+    uint32_t* pte = paging_get_pte(dir, virt, 0);
+    if (pte == NULL || !(*pte & PTE_PRESENT)) return -1;
+
+    *pte = (*pte & PTE_FRAME_MASK) | (flags & PTE_FLAGS_MASK) | PTE_PRESENT;
+    flush_if_current(dir, virt);
+    return 0;
+}
+
+uint32_t paging_translate(uint32_t dir, uint32_t virt) {
+    uint32_t pde = ((uint32_t*)dir)[PDE_INDEX(virt)];
+    if (!(pde & PTE_PRESENT)) return 0;
+    if (pde & PTE_LARGE) {
+        return (pde & ~(LARGE_PAGE_SIZE - 1)) | (virt & (LARGE_PAGE_SIZE - 1));
+    }
+
+    uint32_t pte = ((uint32_t*)(pde & PTE_FRAME_MASK))[PTE_INDEX(virt)];
+    if (!(pte & PTE_PRESENT)) return 0;
+    return (pte & PTE_FRAME_MASK) | (virt & ~PTE_FRAME_MASK);
+}
+
+int paging_map_user_stack(uint32_t dir) {
+    for (uint32_t virt = USER_STACK_BASE; virt < USER_STACK_TOP; virt += PAGE_SIZE) {
+        uint32_t frame = (uint32_t)allocate_pages(1);
+        if (frame == 0) return -1;
+        if (paging_map(dir, virt, frame, PTE_WRITE | PTE_USER) != 0) {
+            free_pages((void*)frame);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Copies a program image to USER_CODE_BASE. Ring 3 may read and run it but
+// not write it, and only copy_page_tables() ever shares the frames.
+int paging_map_user_code(uint32_t dir, const void* code, uint32_t size) {
+    const uint8_t* src = (const uint8_t*)code;
+    for (uint32_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        uint8_t* frame = (uint8_t*)allocate_pages(1);
+        if (frame == NULL) return -1;
+
+        uint32_t chunk = size - offset < PAGE_SIZE ? size - offset : PAGE_SIZE;
+        memcpy(frame, src + offset, chunk);
+        memset(frame + chunk, 0, PAGE_SIZE - chunk);
+        if (paging_map(dir, USER_CODE_BASE + offset, (uint32_t)frame, PTE_USER) != 0) {
+            free_pages(frame);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Shares every user page with the child copy-on-write: both sides lose write
+// access and the first writer takes a private copy in page_fault_handler()
+int copy_page_tables(uint32_t parent_cr3, uint32_t child_cr3) {
+    uint32_t* ppd = (uint32_t*)parent_cr3;
+
+    for (int i = PDE_INDEX(USER_SPACE_START); i < PAGE_ENTRIES; i++) {
+        if (!(ppd[i] & PTE_PRESENT)) continue;
+
+        uint32_t* ppt = (uint32_t*)(ppd[i] & PTE_FRAME_MASK);
+        for (int j = 0; j < PAGE_ENTRIES; j++) {
+            if (!(ppt[j] & (PTE_PRESENT | PTE_SWAPPED))) continue;
+
+            if (ppt[j] & (PTE_WRITE | PTE_COW)) {
+                ppt[j] = (ppt[j] & ~PTE_WRITE) | PTE_COW;
+            }
+
+            uint32_t virt = ((uint32_t)i << 22) | ((uint32_t)j << 12);
+            uint32_t* pte = paging_get_pte(child_cr3, virt, 1);
+            if (pte == NULL) {
+                load_cr3(read_cr3());
+                return -1;
+            }
+            *pte = ppt[j];
+            if (ppt[j] & PTE_PRESENT) {
+                page_get((void*)(ppt[j] & PTE_FRAME_MASK));
+            } else {
+                // Swapped out pages are shared through the swap slot instead
+                swap_dup(ppt[j]);
+            }
+        }
+    }
+
+    // The parent may be running on the pages it just lost write access to
+    if (read_cr3() == parent_cr3) {
+        load_cr3(parent_cr3);
+    }
+    return 0;
+}
+
+static int cow_break(uint32_t* pte) {
+    uint32_t frame = *pte & PTE_FRAME_MASK;
+    uint32_t flags = (*pte & PTE_FLAGS_MASK & ~PTE_COW) | PTE_WRITE;
+
+    if (page_refcount((void*)frame) == 1) {
+        *pte = frame | flags;
+        return 0;
+    }
+
+    uint32_t copy = (uint32_t)allocate_pages(1);
+    if (copy == 0) return -1;
+    copy_memory((void*)copy, (void*)frame, PAGE_SIZE);
+
+    *pte = copy | flags;
+    page_put((void*)frame);
+    return 0;
+}
+
+// Runs as the page fault task; kernel_tss holds the interrupted context,
+// including the address space it faulted in
+void page_fault_handler(uint32_t fault_addr, uint32_t error_code) {
+    uint32_t dir = kernel_tss.cr3;
+
+    if (!(error_code & PF_PRESENT) && fault_addr >= USER_SPACE_START) {
+        uint32_t* pte = paging_get_pte(dir, fault_addr, 0);
+        if (pte != NULL && (*pte & PTE_SWAPPED) && swap_in(pte) == 0) {
+            invlpg(fault_addr & PTE_FRAME_MASK);
+            return;
+        }
+    }
+
+    if ((error_code & PF_PRESENT) && (error_code & PF_WRITE) && fault_addr >= USER_SPACE_START) {
+        uint32_t* pte = paging_get_pte(dir, fault_addr, 0);
+        if (pte != NULL && (*pte & PTE_COW) && cow_break(pte) == 0) {
+            invlpg(fault_addr & PTE_FRAME_MASK);
+            return;
+        }
+    }
+
+    debug_print("DEBUG: Unhandled page fault at address:");
+    debug_int(fault_addr);
+    debug_print("DEBUG: Page fault error code:");
+    debug_int(error_code);
+    debug_print("DEBUG: Faulting instruction:");
+    debug_int(kernel_tss.eip);
+
+    // Ring 3 can't take the kernel down: rewrite the state the task switch
+    // back will load so the process continues in ring 0, on the empty kernel
+    // stack it entered the kernel with, and exits from there
+    if (error_code & PF_USER) {
+        kernel_tss.eip = (uint32_t)process_fault_exit;
+        kernel_tss.cs = GDT_KERNEL_CODE;
+        kernel_tss.ss = GDT_KERNEL_DATA;
+        kernel_tss.ds = GDT_KERNEL_DATA;
+        kernel_tss.es = GDT_KERNEL_DATA;
+        kernel_tss.fs = GDT_KERNEL_DATA;
+        kernel_tss.gs = GDT_KERNEL_DATA;
+        kernel_tss.esp = kernel_tss.esp0;
+        kernel_tss.eflags = 0x2;
+        return;
+    }
+    asm volatile("cli");
+    while (1) {
+        asm volatile("hlt");
+    }
+}
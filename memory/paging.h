@@ -0,0 +1,81 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "memory.h"
+
+// Page directory / page table entry flags
+#define PTE_PRESENT   0x001
+#define PTE_WRITE     0x002
+#define PTE_USER      0x004
+#define PTE_PWT       0x008
+#define PTE_PCD       0x010
+#define PTE_ACCESSED  0x020
+#define PTE_DIRTY     0x040
+#define PTE_LARGE     0x080   // 4 MB page, directory entries only (CR4.PSE)
+#define PTE_GLOBAL    0x100   // survives CR3 reloads (CR4.PGE)
+#define PTE_COW       0x200   // available bit: shared read-only until written
+#define PTE_SWAPPED   0x400   // available bit, not present: contents live in the swap pool (swap.h)
+#define PTE_FLAGS_MASK 0x00000FFF
+#define PTE_FRAME_MASK 0xFFFFF000
+
+#define PAGE_ENTRIES 1024
+#define LARGE_PAGE_SIZE 0x400000
+
+#define PDE_INDEX(virt) ((virt) >> 22)
+#define PTE_INDEX(virt) (((virt) >> 12) & 0x3FF)
+
+// Everything below USER_SPACE_START is the identity mapped kernel, shared by
+// every address space. Each process gets its own mappings above it.
+#define USER_SPACE_START 0x40000000
+#define USER_STACK_TOP   0xC0000000
+#define USER_STACK_PAGES 4
+#define USER_STACK_BASE  (USER_STACK_TOP - USER_STACK_PAGES * PAGE_SIZE)
+#define USER_CODE_BASE   USER_SPACE_START  // where ring 3 program images are loaded
+#define VDSO_BASE        (USER_STACK_TOP - LARGE_PAGE_SIZE)   // kernel-maintained pages, see process/vdso.h
+
+// Page fault error code bits
+#define PF_PRESENT 0x1
+#define PF_WRITE   0x2
+#define PF_USER    0x4
+
+#define CR0_WP  0x00010000
+#define CR0_PG  0x80000000
+#define CR4_PSE 0x00000010
+#define CR4_PGE 0x00000080
+
+static inline uint32_t read_cr3(void) {
+    uint32_t value;
+    asm volatile("mov %%cr3, %0" : "=r"(value));
+    return value;
+}
+
+static inline void load_cr3(uint32_t dir) {
+    asm volatile("mov %0, %%cr3" : : "r"(dir) : "memory");
+}
+
+static inline void invlpg(uint32_t virt) {
+    asm volatile("invlpg (%0)" : : "r"(virt) : "memory");
+}
+
+extern uint32_t kernel_directory;
+
+void paging_init(void);
+
+uint32_t paging_create_directory(void);
+void paging_free_directory(uint32_t dir);
+void paging_switch(uint32_t dir);
+
+uint32_t* paging_get_pte(uint32_t dir, uint32_t virt, int create);
+int paging_map(uint32_t dir, uint32_t virt, uint32_t phys, uint32_t flags);
+uint32_t paging_unmap(uint32_t dir, uint32_t virt);
+int paging_protect(uint32_t dir, uint32_t virt, uint32_t flags);
+uint32_t paging_translate(uint32_t dir, uint32_t virt);
+
+int paging_map_user_stack(uint32_t dir);
+int paging_map_user_code(uint32_t dir, const void* code, uint32_t size);
+int copy_page_tables(uint32_t parent_cr3, uint32_t child_cr3);
+void page_fault_handler(uint32_t fault_addr, uint32_t error_code);
+
+#endif
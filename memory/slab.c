@@ -0,0 +1,149 @@
+#include "slab.h"
+#include "memory.h"
+#include "../keyboard/string.h"
+
+#define SLAB_LIST_PARTIAL 0
+#define SLAB_LIST_FULL    1
+#define SLAB_LIST_EMPTY   2
+
+static slab_cache_t slab_caches[SLAB_NUM_CLASSES];
+
+extern void debug_print(const char* messe);
+
+static size_t slab_class_index(size_t size) {
+    if (size <= (1 << SLAB_MIN_SHIFT)) {
+        return 0;
+    }
+    // ceil(log2(size)) - SLAB_MIN_SHIFT
+    return (32 - __builtin_clz((uint32_t)(size - 1))) - SLAB_MIN_SHIFT;
+}
+
+static slab_t** slab_list_head(slab_cache_t* cache, uint16_t list) {
+    switch (list) {
+        case SLAB_LIST_FULL:  return &cache->full;
+        case SLAB_LIST_EMPTY: return &cache->empty;
+        default:              return &cache->partial;
+    }
+}
+
+static void slab_list_remove(slab_cache_t* cache, slab_t* slab) {
+    slab_t** head = slab_list_head(cache, slab->list);
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *head = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = NULL;
+    slab->prev = NULL;
+    if (slab->list == SLAB_LIST_EMPTY) {
+        cache->num_empty--;
+    }
+}
+
+static void slab_list_push(slab_cache_t* cache, slab_t* slab, uint16_t list) {
+    slab_t** head = slab_list_head(cache, list);
+    slab->list = list;
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head) {
+        (*head)->prev = slab;
+    }
+    *head = slab;
+    if (list == SLAB_LIST_EMPTY) {
+        cache->num_empty++;
+    }
+}
+
+static slab_t* slab_create(slab_cache_t* cache) {
+    uint8_t* mem = (uint8_t*)allocate_slab_pages(cache->pages_per_slab);
+    if (!mem) return NULL;
+
+    slab_t* slab = (slab_t*)mem;
+    slab->cache = cache;
+    slab->in_use = 0;
+    slab->free_list = NULL;
+
+    // Thread the free list back to front so objects are handed out in address order
+    uint8_t* obj = mem + cache->first_obj_offset + (cache->objs_per_slab - 1) * cache->obj_size;
+    for (uint16_t i = 0; i < cache->objs_per_slab; i++) {
+        *(void**)obj = slab->free_list;
+        slab->free_list = obj;
+        obj -= cache->obj_size;
+    }
+    return slab;
+}
+
+void slab_init(void) {
+    for (size_t i = 0; i < SLAB_NUM_CLASSES; i++) {
+        slab_cache_t* cache = &slab_caches[i];
+        cache->obj_size = (size_t)1 << (SLAB_MIN_SHIFT + i);
+
+        size_t bytes = cache->obj_size * SLAB_MIN_OBJECTS;
+        cache->pages_per_slab = bytes > PAGE_SIZE ? bytes / PAGE_SIZE : 1;
+        cache->first_obj_offset = (sizeof(slab_t) + SLAB_OBJ_ALIGN - 1) & ~(size_t)(SLAB_OBJ_ALIGN - 1);
+        cache->objs_per_slab = (uint16_t)((cache->pages_per_slab * PAGE_SIZE - cache->first_obj_offset) / cache->obj_size);
+
+        cache->partial = NULL;
+        cache->full = NULL;
+        cache->empty = NULL;
+        cache->num_empty = 0;
+    }
+    debug_print("DEBUG: Slab caches initialized.");
+}
+
+void* slab_alloc(size_t size) {
+    if (size > SLAB_MAX_SIZE) return NULL;
+
+    slab_cache_t* cache = &slab_caches[slab_class_index(size)];
+
+    slab_t* slab = cache->partial;
+    if (!slab) {
+        slab = cache->empty;
+        if (slab) {
+            slab_list_remove(cache, slab);
+        } else {
+            slab = slab_create(cache);
+            if (!slab) return NULL;
+        }
+        slab_list_push(cache, slab, SLAB_LIST_PARTIAL);
+    }
+
+    void* obj = slab->free_list;
+    slab->free_list = *(void**)obj;
+    slab->in_use++;
+
+    if (slab->in_use == cache->objs_per_slab) {
+        slab_list_remove(cache, slab);
+        slab_list_push(cache, slab, SLAB_LIST_FULL);
+    }
+
+    // kmalloc() has always handed out zeroed memory; keep that for recycled objects
+    memset(obj, 0, cache->obj_size);
+    return obj;
+}
+
+void slab_free(void* ptr) {
+    slab_t* slab = (slab_t*)slab_page_head(ptr);
+    slab_cache_t* cache = slab->cache;
+
+    *(void**)ptr = slab->free_list;
+    slab->free_list = ptr;
+
+    uint16_t was_full = (slab->list == SLAB_LIST_FULL);
+    slab->in_use--;
+
+    if (slab->in_use == 0) {
+        slab_list_remove(cache, slab);
+        if (cache->num_empty >= SLAB_MAX_EMPTY) {
+            free_pages(slab);
+            return;
+        }
+        slab_list_push(cache, slab, SLAB_LIST_EMPTY);
+    } else if (was_full) {
+        slab_list_remove(cache, slab);
+        slab_list_push(cache, slab, SLAB_LIST_PARTIAL);
+    }
+}
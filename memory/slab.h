@@ -0,0 +1,43 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SLAB_MIN_SHIFT 4    // 16 B
+#define SLAB_MAX_SHIFT 11   // 2 KB
+#define SLAB_NUM_CLASSES (SLAB_MAX_SHIFT - SLAB_MIN_SHIFT + 1)
+#define SLAB_MAX_SIZE (1 << SLAB_MAX_SHIFT)
+
+#define SLAB_OBJ_ALIGN 16
+#define SLAB_MIN_OBJECTS 8      // objects per slab we aim for when sizing a slab
+#define SLAB_MAX_EMPTY 1        // empty slabs kept cached per size class
+
+struct slab_cache;
+
+// Lives at the start of the first page of every slab
+typedef struct slab {
+    struct slab_cache* cache;
+    struct slab* next;
+    struct slab* prev;
+    void* free_list;        // singly linked through the free objects themselves
+    uint16_t in_use;
+    uint16_t list;          // SLAB_LIST_* the slab currently sits on
+} slab_t;
+
+typedef struct slab_cache {
+    size_t obj_size;
+    size_t pages_per_slab;
+    size_t first_obj_offset;
+    uint16_t objs_per_slab;
+    slab_t* partial;
+    slab_t* full;
+    slab_t* empty;
+    uint32_t num_empty;
+} slab_cache_t;
+
+void slab_init(void);
+void* slab_alloc(size_t size);
+void slab_free(void* ptr);
+
+#endif
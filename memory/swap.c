@@ -0,0 +1,192 @@
+#include "swap.h"
+#include "paging.h"
+#include "compress.h"
+#include "../keyboard/gdt.h"
+#include "../keyboard/string.h"
+#include "../process/process.h"
+
+typedef struct swap_slot {
+    uint8_t* data;      // compressed page, NULL for a page filled with one repeated dword
+    uint32_t fill;
+    uint16_t length;
+    uint16_t refcount;  // swap entries pointing here; fork shares them like COW frames
+} swap_slot_t;
+
+static swap_slot_t swap_slots[SWAP_MAX_SLOTS];
+static uint16_t free_slots[SWAP_MAX_SLOTS];
+static size_t free_slot_count = 0;
+
+static uint8_t compress_buffer[PAGE_SIZE / 2];
+
+static uint32_t swap_outs = 0;
+static uint32_t swap_ins = 0;
+static uint32_t same_filled = 0;
+static uint32_t rejected = 0;
+static size_t pool_bytes = 0;
+
+extern void debug_print(const char* messe);
+extern void print_to_screen(const char* message);
+extern void int_to_dec(uint32_t num, char *buffer);
+
+void swap_init(void) {
+    for (size_t i = 0; i < SWAP_MAX_SLOTS; i++) {
+        free_slots[i] = (uint16_t)(SWAP_MAX_SLOTS - 1 - i);
+    }
+    free_slot_count = SWAP_MAX_SLOTS;
+    memory_set_reclaim_hook(swap_reclaim);
+    debug_print("DEBUG: Compressed swap initialized.");
+}
+
+static void slot_free(uint32_t slot) {
+    swap_slot_t* s = &swap_slots[slot];
+    if (s->data) {
+        pool_bytes -= s->length;
+        kfree(s->data);
+    }
+    s->data = NULL;
+    s->refcount = 0;
+    free_slots[free_slot_count++] = (uint16_t)slot;
+}
+
+// Compresses the page behind a present, unshared PTE and frees its frame
+int swap_out(uint32_t* pte) {
+    uint32_t frame = *pte & PTE_FRAME_MASK;
+    if (free_slot_count == 0 || page_refcount((void*)frame) != 1) return -1;
+
+    uint32_t slot = free_slots[free_slot_count - 1];
+    swap_slot_t* s = &swap_slots[slot];
+
+    const uint32_t* words = (const uint32_t*)frame;
+    size_t i = 1;
+    while (i < PAGE_SIZE / 4 && words[i] == words[0]) i++;
+
+    if (i == PAGE_SIZE / 4) {
+        s->data = NULL;
+        s->fill = words[0];
+        s->length = 0;
+        same_filled++;
+    } else {
+        size_t length = lz_compress((const uint8_t*)frame, PAGE_SIZE, compress_buffer, SWAP_MAX_COMPRESSED);
+        if (length == 0) {
+            rejected++;
+            return -1;
+        }
+        s->data = (uint8_t*)kmalloc_tagged(length, KMALLOC_TAG_SWAP);
+        if (s->data == NULL) return -1;
+        memcpy(s->data, compress_buffer, length);
+        s->length = (uint16_t)length;
+        pool_bytes += length;
+    }
+
+    free_slot_count--;
+    s->refcount = 1;
+    *pte = SWAP_ENTRY(slot, *pte);
+    page_put((void*)frame);
+    swap_outs++;
+    return 0;
+}
+
+// Called from the page fault task for a swap entry; the caller flushes the TLB
+int swap_in(uint32_t* pte) {
+    uint32_t entry = *pte;
+    uint32_t slot = SWAP_SLOT(entry);
+    swap_slot_t* s = &swap_slots[slot];
+
+    uint32_t frame = (uint32_t)allocate_pages(1);
+    if (frame == 0) return -1;
+
+    if (s->data == NULL) {
+        if (s->fill != 0) {
+            uint32_t* words = (uint32_t*)frame;
+            for (size_t i = 0; i < PAGE_SIZE / 4; i++) {
+                words[i] = s->fill;
+            }
+        }
+    } else if (lz_decompress(s->data, s->length, (uint8_t*)frame, PAGE_SIZE) != PAGE_SIZE) {
+        free_pages((void*)frame);
+        return -1;
+    }
+
+    *pte = frame | (entry & (PTE_WRITE | PTE_USER | PTE_COW)) | PTE_PRESENT;
+    swap_release(entry);
+    swap_ins++;
+    return 0;
+}
+
+void swap_dup(uint32_t pte) {
+    swap_slots[SWAP_SLOT(pte)].refcount++;
+}
+
+void swap_release(uint32_t pte) {
+    swap_slot_t* s = &swap_slots[SWAP_SLOT(pte)];
+    if (s->refcount > 1) {
+        s->refcount--;
+        return;
+    }
+    slot_free(SWAP_SLOT(pte));
+}
+
+// One clock sweep over a process: recently used pages lose their accessed
+// bit and get another chance, the rest are swapped out
+static size_t reclaim_address_space(uint32_t dir, size_t target) {
+    size_t freed = 0;
+    uint32_t* pd = (uint32_t*)dir;
+    for (int i = PDE_INDEX(USER_SPACE_START); i < PAGE_ENTRIES && freed < target; i++) {
+        if (!(pd[i] & PTE_PRESENT) || (pd[i] & PTE_LARGE)) continue;
+
+        uint32_t* pt = (uint32_t*)(pd[i] & PTE_FRAME_MASK);
+        for (int j = 0; j < PAGE_ENTRIES && freed < target; j++) {
+            if (!(pt[j] & PTE_PRESENT)) continue;
+            if (pt[j] & PTE_ACCESSED) {
+                pt[j] &= ~PTE_ACCESSED;
+                continue;
+            }
+            if (swap_out(&pt[j]) == 0) {
+                freed++;
+            }
+        }
+    }
+    return freed;
+}
+
+// Blocked processes are the coldest and go first, then ones parked until
+// their group's next period, then ones waiting to run.
+// Whatever is running, or faulted into the page fault task, is left alone;
+// none of the candidates has its directory loaded, so no TLB flushes are needed.
+size_t swap_reclaim(size_t target) {
+    static const uint32_t victim_states[] = { STATE_BLOCKED, STATE_PARKED, STATE_READY };
+    size_t freed = 0;
+
+    for (int sweep = 0; sweep < 2 && freed < target; sweep++) {
+        for (size_t k = 0; k < sizeof(victim_states) / sizeof(victim_states[0]) && freed < target; k++) {
+            for (PCB* p = process_table_head; p != NULL && freed < target; p = p->next_in_table) {
+                if (p->state != victim_states[k] || p == current_process || p->cr3 == 0
+                        || p->cr3 == read_cr3() || p->cr3 == kernel_tss.cr3) {
+                    continue;
+                }
+                freed += reclaim_address_space(p->cr3, target - freed);
+            }
+        }
+    }
+    return freed;
+}
+
+static void print_stat(const char* label, uint32_t value) {
+    char buffer[16];
+    print_to_screen(label);
+    int_to_dec(value, buffer);
+    print_to_screen(buffer);
+}
+
+void swap_print_stats(void) {
+    uint32_t stored = (uint32_t)(SWAP_MAX_SLOTS - free_slot_count);
+    print_stat("Swapped pages: ", stored);
+    print_stat(" (", (uint32_t)pool_bytes);
+    print_stat(" bytes compressed from ", stored * PAGE_SIZE);
+    print_to_screen(")\n");
+    print_stat("Swap outs: ", swap_outs);
+    print_stat(", swap ins: ", swap_ins);
+    print_stat(", same-filled: ", same_filled);
+    print_stat(", incompressible: ", rejected);
+    print_to_screen("\n");
+}
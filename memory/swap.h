@@ -0,0 +1,26 @@
+#ifndef SWAP_H
+#define SWAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "memory.h"
+
+// Cold user pages of processes that are not running are compressed into
+// kmalloc'd buffers and their PTEs rewritten as swap entries: not present,
+// PTE_SWAPPED set and the pool slot in the frame bits. The page fault task
+// brings them back on first touch.
+#define SWAP_MAX_SLOTS 4096
+#define SWAP_MAX_COMPRESSED (PAGE_SIZE / 2 - sizeof(memory_block_t))   // worse than 2:1 stays resident
+
+#define SWAP_ENTRY(slot, pte) (((uint32_t)(slot) << 12) | ((pte) & (PTE_WRITE | PTE_USER | PTE_COW)) | PTE_SWAPPED)
+#define SWAP_SLOT(pte) ((pte) >> 12)
+
+void swap_init(void);
+int swap_out(uint32_t* pte);
+int swap_in(uint32_t* pte);
+void swap_dup(uint32_t pte);
+void swap_release(uint32_t pte);
+size_t swap_reclaim(size_t target);
+void swap_print_stats(void);
+
+#endif
@@ -0,0 +1,200 @@
+#include <stddef.h>
+#include "group.h"
+#include "process.h"
+#include "sched.h"
+#include "../keyboard/io.h"
+#include "../interrupts/timer.h"
+
+extern void int_to_dec(uint32_t num, char *buffer);
+
+static sched_group_t groups[SCHED_GROUPS_MAX];
+
+static void group_throttle(sched_group_t* group) {
+    if (!group->throttled) {
+        group->throttled = 1;
+        group->throttled_since = rdtsc();
+        group->nr_throttled++;
+    }
+}
+
+// Timer callback at each period boundary. An overrun is paid back out of
+// the new quota, so a member can't beat the limit by overshooting its tick.
+static void group_period(void* data) {
+    sched_group_t* group = (sched_group_t*)data;
+    group->nr_periods++;
+    group->used_cycles = group->used_cycles > group->quota_cycles
+                       ? group->used_cycles - group->quota_cycles : 0;
+
+    if (group->throttled && group->used_cycles < group->quota_cycles) {
+        group->throttled = 0;
+        group->throttled_cycles += rdtsc() - group->throttled_since;
+        while (group->parked != NULL) {
+            PCB* process = group->parked;
+            group->parked = process->next;
+            process->next = NULL;
+            process->state = STATE_READY;
+            sched_wakeup(process);
+        }
+    }
+    ktimer_arm(&group->period_timer, timer_ticks + timer_ms_to_ticks(group->period_ms));
+}
+
+sched_group_t* group_create(uint32_t quota_ms, uint32_t period_ms) {
+    for (int i = 0; i < SCHED_GROUPS_MAX; i++) {
+        if (groups[i].id == 0) {
+            sched_group_t* group = &groups[i];
+            ktimer_init(&group->period_timer, group_period, group);
+            if (group_set_bandwidth(group, quota_ms, period_ms) != 0) {
+                return NULL;
+            }
+            group->id = i + 1;
+            return group;
+        }
+    }
+    return NULL;
+}
+
+sched_group_t* group_find(int id) {
+    if (id < 1 || id > SCHED_GROUPS_MAX || groups[id - 1].id == 0) {
+        return NULL;
+    }
+    return &groups[id - 1];
+}
+
+// Takes effect straight away and starts a new period
+int group_set_bandwidth(sched_group_t* group, uint32_t quota_ms, uint32_t period_ms) {
+    if (quota_ms == 0 || period_ms == 0 || quota_ms > period_ms) {
+        return -1;
+    }
+
+    uint32_t flags = irq_save();
+    group->quota_ms = quota_ms;
+    group->period_ms = period_ms;
+    group->quota_cycles = (uint64_t)quota_ms * timer_tsc_per_tick() * timer_frequency() / 1000;
+    // A fresh period: whatever was used so far no longer counts
+    group->used_cycles = group->quota_cycles;
+    group_period(group);
+    irq_restore(flags);
+    return 0;
+}
+
+static bool group_unpark(sched_group_t* group, PCB* process) {
+    for (PCB** link = &group->parked; *link != NULL; link = &(*link)->next) {
+        if (*link == process) {
+            *link = process->next;
+            process->next = NULL;
+            process->state = STATE_READY;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Moves a process to group, or out of any group if it is NULL. A parked
+// process is woken, and parked again if the new group is throttled too.
+void group_attach(PCB* process, sched_group_t* group) {
+    uint32_t flags = irq_save();
+    sched_group_t* old = process->group;
+    if (old == group) {
+        irq_restore(flags);
+        return;
+    }
+
+    bool parked = false;
+    if (old != NULL) {
+        old->members--;
+        parked = group_unpark(old, process);
+    }
+    process->group = group;
+    if (group != NULL) {
+        group->members++;
+    }
+    if (parked) {
+        sched_wakeup(process);
+    }
+    irq_restore(flags);
+}
+
+void group_charge(PCB* process, uint64_t cycles) {
+    sched_group_t* group = process->group;
+    if (group == NULL) return;
+
+    group->used_cycles += cycles;
+    if (group->used_cycles >= group->quota_cycles) {
+        group_throttle(group);
+    }
+}
+
+// Called on the tick with the cycles the running process has not been
+// charged for yet; throttles the group once they would exceed its quota
+bool group_over_quota(PCB* process, uint64_t running) {
+    sched_group_t* group = process->group;
+    if (group == NULL) return false;
+
+    if (!group->throttled && group->used_cycles + running >= group->quota_cycles) {
+        group_throttle(group);
+    }
+    return group->throttled;
+}
+
+bool group_throttled(PCB* process) {
+    return process->group != NULL && process->group->throttled;
+}
+
+// Keeps a runnable member off the run queues until the next period, in
+// arrival order. Parked processes have a state of their own, so nothing that
+// wakes blocked ones picks them up, and parking one twice is a no-op; taking
+// one off the list makes it ready again before it is woken.
+void group_park(PCB* process) {
+    if (process->state == STATE_PARKED) return;
+
+    PCB** link = &process->group->parked;
+    while (*link != NULL) {
+        link = &(*link)->next;
+    }
+    process->state = STATE_PARKED;
+    process->next = NULL;
+    *link = process;
+}
+
+static void out_dec(void (*out)(const char*), uint32_t value) {
+    char buffer[16];
+    int_to_dec(value, buffer);
+    out(buffer);
+}
+
+static uint32_t cycles_to_ms(uint64_t cycles) {
+    uint32_t cycles_per_ms = (uint32_t)(timer_tsc_per_tick() * timer_frequency() / 1000);
+    return cycles_per_ms ? (uint32_t)(cycles / cycles_per_ms) : 0;
+}
+
+void group_print_stats(void (*out)(const char*)) {
+    uint32_t flags = irq_save();
+    uint64_t now = rdtsc();
+    out("  ID  QUOTA/PERIOD ms  MEMBERS  PERIODS  THROTTLED  THROTTLED ms\n");
+    for (int i = 0; i < SCHED_GROUPS_MAX; i++) {
+        sched_group_t* group = &groups[i];
+        if (group->id == 0) continue;
+
+        uint64_t throttled = group->throttled_cycles;
+        if (group->throttled) {
+            throttled += now - group->throttled_since;
+        }
+        out("  ");
+        out_dec(out, (uint32_t)group->id);
+        out("  ");
+        out_dec(out, group->quota_ms);
+        out("/");
+        out_dec(out, group->period_ms);
+        out("  ");
+        out_dec(out, group->members);
+        out("  ");
+        out_dec(out, group->nr_periods);
+        out("  ");
+        out_dec(out, group->nr_throttled);
+        out("  ");
+        out_dec(out, cycles_to_ms(throttled));
+        out(group->throttled ? "  (throttled)\n" : "\n");
+    }
+    irq_restore(flags);
+}
@@ -0,0 +1,44 @@
+#ifndef GROUP_H
+#define GROUP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../interrupts/timer_wheel.h"
+
+#define SCHED_GROUPS_MAX 8
+
+struct PCB;
+
+// CPU bandwidth group: its members together may run for quota out of every
+// period. Once they have used it up they are throttled, i.e. parked off the
+// run queues, until the period timer hands out the next quota.
+typedef struct sched_group {
+    int id;                     // 1-based; 0 marks a free slot
+    uint32_t quota_ms;
+    uint32_t period_ms;
+    uint64_t quota_cycles;      // quota_ms in TSC cycles
+    uint64_t used_cycles;       // run by members this period
+    int throttled;
+    struct PCB* parked;         // runnable members waiting for the next period, linked by next
+    ktimer_t period_timer;
+    uint32_t members;
+    uint32_t nr_periods;
+    uint32_t nr_throttled;      // periods in which the group ran out of quota
+    uint64_t throttled_since;   // TSC when the current throttling began
+    uint64_t throttled_cycles;  // total time spent throttled
+} sched_group_t;
+
+sched_group_t* group_create(uint32_t quota_ms, uint32_t period_ms);
+sched_group_t* group_find(int id);
+int group_set_bandwidth(sched_group_t* group, uint32_t quota_ms, uint32_t period_ms);
+void group_attach(struct PCB* process, sched_group_t* group);
+
+// Used by the scheduler, interrupts off
+void group_charge(struct PCB* process, uint64_t cycles);
+bool group_over_quota(struct PCB* process, uint64_t running);
+bool group_throttled(struct PCB* process);
+void group_park(struct PCB* process);
+
+void group_print_stats(void (*out)(const char*));
+
+#endif
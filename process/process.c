@@ -1,235 +1,532 @@
+#include <stddef.h>
 #include "process.h"
 #include "../memory/memory.h"
+#include "../memory/paging.h"
+#include "../keyboard/gdt.h"
+#include "../keyboard/io.h"
+#include "../keyboard/string.h"
+#include "../interrupts/timer.h"
 #include "syscall.h"
-#include "rbtree.h"
-#define DEFAULT_NORM_WEIGHT 1024
-PCB* current_process = NULL;
-ProcessQueue ready_queue = {NULL, NULL};
+#include "sched.h"
+#include "vdso.h"
+
+// pid 0 is the boot context running the CLI. It is never queued: it runs
+// whenever nothing else can, and is left through an explicit schedule() or
+// when a blocked process wakes up.
+PCB idle_task = { .pid = 0, .state = STATE_RUNNING };
+PCB* current_process = &idle_task;
 PCB* process_table_head = NULL;
+static PCB* pid_hash[PID_HASH_SIZE];
 static uint32_t next_pid = 1;
+// Exited processes nobody will wait for, freed once they are no longer running
+static PCB* reap_list = NULL;
 
 extern void debug_print(const char* messe);
 extern void print_to_screen(const char* message);
 extern void debug_int(int val);
-extern void cli_loop(void);
+extern void int_to_dec(uint32_t num, char *buffer);
+
+// switch.asm addresses the context and cr3 through the PCB pointer
+_Static_assert(offsetof(PCB, context) == 0, "switch.asm expects the context first");
+_Static_assert(offsetof(PCB, cr3) == sizeof(cpu_context_t), "switch.asm expects cr3 after the context");
+
+#define BENCH_SWITCHES 10000
 
-struct rb_root cfs_rq = RB_ROOT; 
 uint32_t get_new_pid() {
     return next_pid++;
 }
 
-void initialize_queue(ProcessQueue* queue) {
-    queue->front = NULL;
-    queue->rear = NULL;
+int allocate_kernel_stack(PCB* process) {
+    process->kernel_stack_base = (uint32_t*)arena_alloc(process->arena, KERNEL_STACK_SIZE);
+    if (process->kernel_stack_base == NULL) {
+        return -1;
+    }
+    process->kernel_stack_ptr = process->kernel_stack_base + (KERNEL_STACK_SIZE/sizeof(uint32_t));
+    return 0;
 }
 
-bool is_queue_empty(ProcessQueue* queue) {
-    return queue->front == NULL;
-}
-void enqueue_process(ProcessQueue* queue, PCB* process) {
-    process->next = NULL;
-    if (is_queue_empty(queue)) {
-        queue->front = process;
-        queue->rear = process;
-        return;
+// Every process owns an arena; the PCB is its first allocation
+PCB* process_alloc(void) {
+    arena_t* arena = arena_create();
+    if (arena == NULL) {
+        return NULL;
     }
-    if (process->priority < queue->front->priority) {
-        process->next = queue->front;
-        queue->front = process;
-        return;
+    PCB* process = (PCB*)arena_alloc(arena, sizeof(PCB));
+    if (process == NULL) {
+        arena_destroy(arena);
+        return NULL;
     }
+    process->arena = arena;
+    return process;
+}
 
-    PCB* current = queue->front;
-    while (current->next && current->next->priority <= process->priority) {
-        current = current->next;
+// Releases the address space and the arena, which takes the PCB and kernel stack with it
+void process_free(PCB* process) {
+    ktimer_cancel(&process->wait_timer);
+    if (process->waiting_on != NULL) {
+        wait_queue_remove(process->waiting_on, process);
     }
-    process->next = current->next;
-    current->next = process;
-    if (process->next == NULL) {
-        queue->rear = process;
+    if (process->cr3 != 0) {
+        paging_free_directory(process->cr3);
     }
+    vdso_release(process);
+    arena_destroy(process->arena);
 }
-void enqueue_process_edf(ProcessQueue* queue, PCB* process) {
-    process->next = NULL;
-    if (is_queue_empty(queue)) {
-        queue->front = process;
-        queue->rear = process;
-        return;
-    }
-    if (process->deadline < queue->front->deadline) {
-        process->next = queue->front;
-        queue->front = process;
-        return;
-    }
 
-    PCB* current = queue->front;
-    while (current->next && current->next->deadline <= process->deadline) {
-        current = current->next;
-    }
-    process->next = current->next;
-    current->next = process;
-    if (process->next == NULL) {
-        queue->rear = process;
+static PCB** pid_bucket(uint32_t pid) {
+    return &pid_hash[pid & (PID_HASH_SIZE - 1)];
+}
+
+// Callers hold interrupts off for all process table and family list operations
+void process_table_add(PCB* process) {
+    process->prev_in_table = NULL;
+    process->next_in_table = process_table_head;
+    if (process_table_head != NULL) {
+        process_table_head->prev_in_table = process;
     }
+    process_table_head = process;
+
+    PCB** bucket = pid_bucket(process->pid);
+    process->hash_next = *bucket;
+    *bucket = process;
 }
-void enqueue_process_sjf(ProcessQueue* queue, PCB* process) {
-    process->next = NULL;
-    if (is_queue_empty(queue)) {
-        queue->front = process;
-        queue->rear = process;
+
+// Safe to call on a process that has already been removed
+void process_table_remove(PCB* process) {
+    if (process->prev_in_table == NULL && process_table_head != process) {
         return;
     }
-    if (process->time_to_run < queue->front->time_to_run) {
-        process->next = queue->front;
-        queue->front = process;
-        return;
+    if (process->prev_in_table != NULL) {
+        process->prev_in_table->next_in_table = process->next_in_table;
+    } else {
+        process_table_head = process->next_in_table;
     }
-
-    PCB* current = queue->front;
-    while (current->next && current->next->time_to_run <= process->time_to_run) {
-        current = current->next;
+    if (process->next_in_table != NULL) {
+        process->next_in_table->prev_in_table = process->prev_in_table;
     }
-    process->next = current->next;
-    current->next = process;
-    if (process->next == NULL) {
-        queue->rear = process;
+    process->next_in_table = NULL;
+    process->prev_in_table = NULL;
+
+    PCB** link = pid_bucket(process->pid);
+    while (*link != NULL) {
+        if (*link == process) {
+            *link = process->hash_next;
+            break;
+        }
+        link = &(*link)->hash_next;
     }
+    process->hash_next = NULL;
 }
 
-static void cfs_enqueue(PCB *p) {
-    struct rb_node **link = &cfs_rq.rb_node, *parent = NULL;
-    while (*link) {
-        PCB *q = rb_entry(*link, PCB, vr_node);
-        parent = *link;
-        if (p->vruntime < q->vruntime)
-            link = &(*link)->rb_left;
-        else
-            link = &(*link)->rb_right;
+PCB* process_find(uint32_t pid) {
+    PCB* process = *pid_bucket(pid);
+    while (process != NULL && process->pid != pid) {
+        process = process->hash_next;
     }
-    rb_link_node(&p->vr_node, parent, link);
-    rb_insert_color(&p->vr_node, &cfs_rq);
+    return process;
+}
+
+// A child sits on exactly one of its parent's lists: zombies once it has exited, children before
+static PCB** sibling_list(PCB* child) {
+    return child->state == STATE_ZOMBIE ? &child->parent->zombies : &child->parent->children;
 }
 
-static PCB* cfs_dequeue_min(void) {
-    struct rb_node *n = rb_first(&cfs_rq);
-    if (!n) return NULL;
-    PCB *p = rb_entry(n, PCB, vr_node);
-    rb_erase(n, &cfs_rq);
-    return p;
+static void sibling_push(PCB** head, PCB* child) {
+    child->sibling_prev = NULL;
+    child->sibling_next = *head;
+    if (*head != NULL) {
+        (*head)->sibling_prev = child;
+    }
+    *head = child;
 }
 
+void process_add_child(PCB* parent, PCB* child) {
+    child->parent = parent;
+    sibling_push(&parent->children, child);
+    vdso_update_process(child);
+}
 
-PCB* dequeue_process(ProcessQueue* queue) {
-    if (is_queue_empty(queue)) {
-        return NULL;
+void process_unlink_child(PCB* child) {
+    if (child->parent == NULL) return;
+    if (child->sibling_prev != NULL) {
+        child->sibling_prev->sibling_next = child->sibling_next;
+    } else {
+        *sibling_list(child) = child->sibling_next;
     }
-    
-    PCB* process = queue->front;
-    queue->front = queue->front->next;
-    
-    if (queue->front == NULL) {
-        queue->rear = NULL;
-    }
-    
-    process->next = NULL;
-    debug_print("DEBUG: Dequeued process has pid:");
-    debug_int(process->pid);
-    return process;
+    if (child->sibling_next != NULL) {
+        child->sibling_next->sibling_prev = child->sibling_prev;
+    }
+    child->sibling_next = NULL;
+    child->sibling_prev = NULL;
+    child->parent = NULL;
+    vdso_update_process(child);
 }
 
-void allocate_kernel_stack(PCB* process) {
-    process->kernel_stack_base = (uint32_t*)kmalloc(KERNEL_STACK_SIZE);
-    process->kernel_stack_ptr = process->kernel_stack_base + (KERNEL_STACK_SIZE/sizeof(uint32_t));
+// Moves an exiting child over to its parent's zombies list
+void process_child_exited(PCB* child) {
+    PCB* parent = child->parent;
+    process_unlink_child(child);
+    child->state = STATE_ZOMBIE;
+    child->parent = parent;
+    sibling_push(&parent->zombies, child);
 }
 
-void schedule() {
-    if (current_process != NULL) {
-        if (current_process->state == STATE_RUNNING) {
-            current_process->state = STATE_READY;
-            enqueue_process(&ready_queue, current_process);
+// A process can't free the stack and address space it is running on, so
+// orphans are parked here and freed by the next schedule() that runs elsewhere
+void process_defer_reap(PCB* process) {
+    process_table_remove(process);
+    process->state = STATE_EXIT;
+    process->next = reap_list;
+    reap_list = process;
+}
+
+static void reap_deferred(void) {
+    PCB** link = &reap_list;
+    while (*link != NULL) {
+        PCB* process = *link;
+        if (process == current_process) {
+            link = &process->next;
+            continue;
         }
+        *link = process->next;
+        debug_print("DEBUG: Reaping orphaned process with pid:");
+        debug_int(process->pid);
+        process_free(process);
     }
-    
-    PCB* next_process = dequeue_process(&ready_queue);
-    if (next_process == NULL) {
+}
+
+// Parks the current process, unless it is still the best choice, and runs
+// the next one. Returns once the caller is switched back in. With nothing
+// runnable the idle task, i.e. the CLI, gets the CPU.
+static void do_schedule(bool preempted) {
+    uint32_t flags = irq_save();
+    PCB* prev = current_process;
+
+    reap_deferred();
+    sched_put_prev(prev, preempted);
+
+    PCB* next = sched_pick_next();
+    if (next == NULL) {
         debug_print("DEBUG: No more processes in ready queue");
-        cli_loop();
-        while(1);
-    }
-    
-    next_process->state = STATE_RUNNING;
-    
-    debug_print("DEBUG: Switching to process:");
-    debug_int(next_process->pid);
-    
-    if (current_process != NULL) {
-        __asm__ volatile (
-            "movl %%esp, %0\n\t"
-            : "=m" (current_process->kernel_stack_ptr)
-        );
-    }
-
-     if (next_process->is_new_child) {
-        next_process->is_new_child = false;
-        
-        current_process = next_process;
-        __asm__ volatile (
-            "xorl %%eax, %%eax\n\t"  
-            "movl %0, %%esp\n\t"     
-            "popl %%ebp\n\t"        
-            "ret\n\t"              
-            : : "r" (next_process->user_stack_ptr) : "eax"
-        );
-    }
-    
-    current_process = next_process;
-    
-    __asm__ volatile (
-        "movl %0, %%esp\n\t"     
-        "popl %%ebp\n\t"         
-        "ret\n\t"                
-        : : "r" (next_process->user_stack_ptr)
-    );
+        next = &idle_task;
+    }
+    sched_start(next);
+
+    if (next != prev) {
+        if (preempted) {
+            prev->nivcsw++;
+        } else {
+            prev->nvcsw++;
+        }
+        debug_print("DEBUG: Switching to process:");
+        debug_int(next->pid);
+        current_process = next;
+        tss_set_kernel_stack((uint32_t)next->kernel_stack_ptr);
+        switch_to(prev, next);
+    }
+    irq_restore(flags);
+}
+
+// Called by the IRQ stubs after the handler, interrupts still off. The
+// preempted process resumes by returning from here into the stub, whose
+// popa/iretd restore every register and its EFLAGS.
+void irq_preempt(void) {
+    if (!need_resched || current_process->state != STATE_RUNNING) {
+        return;
+    }
+    do_schedule(true);
 }
 
+void schedule() {
+    do_schedule(false);
+}
 
-PCB* create_process(uint32_t pid, uint32_t* entry_point, int priority, int deadline, int time_to_run) {
-    PCB* new_process = (PCB*) kmalloc(sizeof(PCB));
-    if (new_process == NULL) {
-        return NULL;
+// A process whose entry function returns ends up here
+static void process_return(void) {
+    exit_syscall(0);
+}
+
+// Gives a fresh PCB its address space, stacks and a context that starts at entry_point
+static int process_setup(PCB* process, uint32_t* entry_point) {
+    process->cr3 = paging_create_directory();
+    if (process->cr3 == 0 || paging_map_user_stack(process->cr3) != 0
+            || vdso_map(process) != 0 || allocate_kernel_stack(process) != 0) {
+        return -1;
     }
 
-    uint32_t *stack_top = (uint32_t *) kmalloc(4096);
-    if (!stack_top) {
-        return NULL;
+    // The stack sits at the same virtual address in every process; seed it through its identity mapping
+    uint32_t *stack_top = (uint32_t *) (paging_translate(process->cr3, USER_STACK_TOP - PAGE_SIZE) + PAGE_SIZE);
+    *(--stack_top) = (uint32_t)process_return;
+
+    process->user_stack_base = (uint32_t *) USER_STACK_BASE;
+    process->context.esp = USER_STACK_TOP - sizeof(uint32_t);
+    process->context.eip = (uint32_t)entry_point;
+    process->context.eflags = EFLAGS_DEFAULT;
+    return 0;
+}
+
+// Like process_setup(), for a program that runs in ring 3: the address space
+// gets a copy of its image, and the first switch in lands in syscall_return()
+// with a trap frame that irets to entry, an offset into the image
+static int process_setup_user(PCB* process, const void* image, uint32_t size, uint32_t entry) {
+    process->cr3 = paging_create_directory();
+    if (process->cr3 == 0 || paging_map_user_stack(process->cr3) != 0
+            || paging_map_user_code(process->cr3, image, size) != 0
+            || vdso_map(process) != 0 || allocate_kernel_stack(process) != 0) {
+        return -1;
     }
-    stack_top += 4096 / sizeof(uint32_t);
 
+    trap_frame_t* frame = (trap_frame_t*)process->kernel_stack_ptr - 1;
+    memset(frame, 0, sizeof(*frame));
+    frame->ds = GDT_USER_DATA | GDT_RPL_USER;
+    frame->es = GDT_USER_DATA | GDT_RPL_USER;
+    frame->eip = USER_CODE_BASE + entry;
+    frame->cs = GDT_USER_CODE | GDT_RPL_USER;
+    frame->eflags = EFLAGS_DEFAULT;
+    frame->user_esp = USER_STACK_TOP;
+    frame->user_ss = GDT_USER_DATA | GDT_RPL_USER;
+
+    process->user_stack_base = (uint32_t *) USER_STACK_BASE;
+    process->context.esp = (uint32_t)frame;
+    process->context.eip = (uint32_t)syscall_return;
+    process->context.eflags = EFLAGS_DEFAULT & ~EFLAGS_IF;     // until the iret
+    return 0;
+}
+
+static PCB* process_launch(PCB* new_process, uint32_t pid, int priority, int deadline, int time_to_run) {
     new_process->pid = pid;
+    vdso_update_process(new_process);
     new_process->state = STATE_NEW;
     new_process->priority = priority;  
     new_process->deadline = deadline;
     new_process->time_to_run = time_to_run;
-    new_process->user_stack_base = stack_top - 1024;
-
-    *(--stack_top) = (uint32_t)entry_point;
-    *(--stack_top) = 0x0;
-    
-    new_process->user_stack_ptr = stack_top;
+    new_process->weight = priority_to_weight(priority);
+    new_process->policy = sched_default_policy;
 
-    new_process->cr3 = 0;
     new_process->next = NULL;
 
-    allocate_kernel_stack(new_process);
-    new_process->next_in_table = process_table_head;
-    process_table_head = new_process;
-
-    new_process->state = STATE_READY;
-    enqueue_process(&ready_queue, new_process);
+    uint32_t flags = irq_save();
+    process_table_add(new_process);
+    sched_add_new(new_process);
+    irq_restore(flags);
     return new_process;
 }
 
+PCB* create_process(uint32_t pid, uint32_t* entry_point, int priority, int deadline, int time_to_run) {
+    PCB* new_process = process_alloc();
+    if (new_process == NULL) {
+        return NULL;
+    }
+
+    if (process_setup(new_process, entry_point) != 0) {
+        process_free(new_process);
+        return NULL;
+    }
+    return process_launch(new_process, pid, priority, deadline, time_to_run);
+}
+
+PCB* create_user_process(uint32_t pid, const void* image, uint32_t size, uint32_t entry,
+                         int priority, int deadline, int time_to_run) {
+    PCB* new_process = process_alloc();
+    if (new_process == NULL) {
+        return NULL;
+    }
+
+    if (process_setup_user(new_process, image, size, entry) != 0) {
+        process_free(new_process);
+        return NULL;
+    }
+    return process_launch(new_process, pid, priority, deadline, time_to_run);
+}
+
+// Where a ring 3 process goes, on its kernel stack, after a fault the kernel
+// can't fix up: see page_fault_handler() and exceptions.asm
+void process_fault_exit(void) {
+    debug_print("DEBUG: Killing process after an unhandled fault, PID:");
+    debug_int(current_process->pid);
+    exit_syscall(-1);
+}
+
+static PCB* bench_peer = NULL;
+
+static void bench_peer_loop(void) {
+    for (;;) {
+        switch_to(bench_peer, &idle_task);
+    }
+}
+
+// Ping-pongs between the CLI and a process with its own address space, so
+// every switch pays for the CR3 reload like a real one does
+void context_switch_bench(void) {
+    PCB* peer = process_alloc();
+    if (peer == NULL || process_setup(peer, (uint32_t*)bench_peer_loop) != 0) {
+        if (peer != NULL) process_free(peer);
+        print_to_screen("bench ctxsw: out of memory\n");
+        return;
+    }
+    // current_process stays &idle_task throughout, so a tick taken on the
+    // peer would save its stack as the CLI's: keep interrupts off over there
+    peer->context.eflags &= ~EFLAGS_IF;
+    bench_peer = peer;
+
+    // Warm-up, left out of the timing: the first switch enters the peer at
+    // bench_peer_loop() instead of inside switch_to(), and brings its stack,
+    // page tables and TLB entries into the caches
+    uint32_t flags = irq_save();
+    switch_to(&idle_task, peer);
+    uint64_t start = rdtsc();
+    for (uint32_t i = 0; i < BENCH_SWITCHES; i++) {
+        switch_to(&idle_task, peer);
+    }
+    uint32_t cycles = (uint32_t)(rdtsc() - start) / (2 * BENCH_SWITCHES);
+    irq_restore(flags);
+
+    bench_peer = NULL;
+    process_free(peer);
+
+    char buffer[16];
+    int_to_dec(cycles, buffer);
+    print_to_screen("Cycles per context switch: ");
+    print_to_screen(buffer);
+    print_to_screen("\n");
+}
+
+static const char* state_name(uint32_t state) {
+    switch (state) {
+        case STATE_READY:   return "ready";
+        case STATE_RUNNING: return "run";
+        case STATE_BLOCKED: return "blocked";
+        case STATE_NEW:     return "new";
+        case STATE_EXIT:    return "exit";
+        case STATE_ZOMBIE:  return "zombie";
+        case STATE_PARKED:  return "parked";
+        default:            return "?";
+    }
+}
+
+static uint32_t cycles_to_ms(uint64_t cycles) {
+    uint32_t cycles_per_ms = (uint32_t)(timer_tsc_per_tick() * timer_frequency() / 1000);
+    return cycles_per_ms ? (uint32_t)(cycles / cycles_per_ms) : 0;
+}
+
+// Right-aligns numbers and left-aligns text in a column of the given width
+static void out_column(void (*out)(const char*), const char* text, int width, bool right) {
+    int pad = width - (int)strlen(text);
+    if (right) {
+        for (; pad > 0; pad--) out(" ");
+    }
+    out(text);
+    if (!right) {
+        for (; pad > 0; pad--) out(" ");
+    }
+}
+
+static void out_number(void (*out)(const char*), uint32_t value, int width) {
+    char buffer[16];
+    int_to_dec(value, buffer);
+    if (width == 0) {
+        out(buffer);
+    } else {
+        out_column(out, buffer, width, true);
+    }
+}
+
+// Priorities are nice values, so they can be negative
+static void out_signed(void (*out)(const char*), int value, int width) {
+    char buffer[16];
+    uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+    int_to_dec(magnitude, buffer + 1);
+    char* text = buffer + 1;
+    if (value < 0) {
+        buffer[0] = '-';
+        text = buffer;
+    }
+    if (width == 0) {
+        out(text);
+    } else {
+        out_column(out, text, width, true);
+    }
+}
+
+static void print_process_line(void (*out)(const char*), int format, PCB* process,
+                               uint64_t now, uint64_t interval) {
+    uint64_t run = process->run_cycles;
+    if (process == current_process) {
+        run += now - process->last_switch;
+    }
+    const char* policy = process == &idle_task ? "-" : sched_policy_name(process->policy);
+
+    if (format == PROCESS_STATS_CSV) {
+        out("ps,");
+        out_number(out, timer_ticks, 0);
+        out(",");
+        out_number(out, process->pid, 0);
+        out(",");
+        out(state_name(process->state));
+        out(",");
+        out(policy);
+        out(",");
+        out_signed(out, process->priority, 0);
+        out(",");
+        out_number(out, cycles_to_ms(run), 0);
+        out(",");
+        out_number(out, cycles_to_ms(process->wait_cycles), 0);
+        out(",");
+        out_number(out, process->nvcsw, 0);
+        out(",");
+        out_number(out, process->nivcsw, 0);
+        out(",");
+        out_number(out, process->syscalls, 0);
+        out("\n");
+        return;
+    }
+
+    if (format == PROCESS_STATS_TOP) {
+        uint32_t share = interval ? (uint32_t)((run - process->top_sample) * 100 / interval) : 0;
+        process->top_sample = run;
+        out_number(out, share, 4);
+        out("%");
+    }
+    out_number(out, process->pid, 5);
+    out(" ");
+    out_column(out, state_name(process->state), 8, false);
+    out_column(out, policy, 5, false);
+    out_signed(out, process->priority, 4);
+    out_number(out, cycles_to_ms(run), 9);
+    out_number(out, cycles_to_ms(process->wait_cycles), 9);
+    out_number(out, process->nvcsw, 7);
+    out_number(out, process->nivcsw, 7);
+    out_number(out, process->syscalls, 9);
+    out("\n");
+}
+
+// Runs with interrupts off so no process is freed under the walk. The CSV
+// form is "ps,tick,pid,state,policy,priority,run_ms,wait_ms,nvcsw,nivcsw,syscalls".
+void process_print_stats(void (*out)(const char*), int format) {
+    static uint64_t last_top = 0;
+    uint32_t flags = irq_save();
+    uint64_t now = rdtsc();
+    uint64_t interval = now - last_top;
+
+    if (format == PROCESS_STATS_CSV) {
+        out("ps,tick,pid,state,policy,priority,run_ms,wait_ms,nvcsw,nivcsw,syscalls\n");
+    } else {
+        if (format == PROCESS_STATS_TOP) {
+            out("  CPU");
+            last_top = now;
+        }
+        out("  PID STATE   POL  PRIO   RUN ms  WAIT ms   VCSW  IVCSW SYSCALLS\n");
+    }
+
+    print_process_line(out, format, &idle_task, now, interval);
+    for (PCB* process = process_table_head; process != NULL; process = process->next_in_table) {
+        print_process_line(out, format, process, now, interval);
+    }
+    irq_restore(flags);
+}
+
 void init_process_management() {
+    idle_task.cr3 = read_cr3();
     initialize_queue(&ready_queue);
     debug_print("DEBUG: Process queues initialized.");
     debug_print("DEBUG: Process management system initialized.");
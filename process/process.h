@@ -4,56 +4,150 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "rbtree.h"
+#include "../memory/arena.h"
+#include "../interrupts/timer_wheel.h"
+#include "wait.h"
 
 #define KERNEL_STACK_SIZE 4096
 
+#define PID_HASH_SIZE 256       // buckets in the pid -> PCB table, a power of two
+
+#define SCHED_TIMESLICE_MS 50   // how long a process runs before the timer may preempt it
+
+// Priorities double as nice values: -20 is the most important, 19 the least
+#define PRIO_MIN (-20)
+#define PRIO_MAX 19
+#define PRIO_LEVELS (PRIO_MAX - PRIO_MIN + 1)
+#define PRIO_BITMAP_WORDS ((PRIO_LEVELS + 31) / 32)
+
+#define DL_LATENESS_BUCKETS 6   // EDF lateness histogram: on time, then powers of two
+
+#define EFLAGS_IF      0x00000200
+#define EFLAGS_DEFAULT 0x00000202   // reserved bit 1 plus interrupts enabled
+
 #define STATE_READY    0
 #define STATE_RUNNING  1
 #define STATE_BLOCKED  2
 #define STATE_NEW      3
 #define STATE_EXIT     4
 #define STATE_ZOMBIE   5
+#define STATE_PARKED   6    // runnable, but its bandwidth group is out of quota (group.c)
+
+// Registers switch_to() saves for a process that is not running. ESP and
+// EIP are where it continues; EAX reads 0 when it does.
+typedef struct cpu_context {
+    uint32_t ebx;
+    uint32_t esi;
+    uint32_t edi;
+    uint32_t ebp;
+    uint32_t esp;
+    uint32_t eip;
+    uint32_t eflags;
+} cpu_context_t;
 
 typedef struct PCB {
+    cpu_context_t context;  // switch.asm relies on context coming first and cr3 right after it
+    uint32_t cr3;
     uint32_t pid;
     uint32_t state;
-    uint32_t* user_stack_ptr;
-    uint32_t cr3;
     int priority;  // Process priority (lower number = higher priority)
-    int deadline;  // Deadline for the process
-    int time_to_run;  // Time slice for the process
+    int deadline;  // EDF: relative deadline and period, in ticks
+    int time_to_run;  // EDF: budget per period, in ticks
+    int policy;       // SCHED_POLICY_*: which scheduler class runs it
     struct PCB* next;           // Next in the ready queue
     struct PCB* next_in_table;  // Next in the process table
+    struct PCB* prev_in_table;
+    struct PCB* hash_next;      // Next in the same PID hash bucket
     struct PCB* parent;
+    struct PCB* children;       // Children that are still running
+    struct PCB* zombies;        // Children that exited and wait to be reaped
+    struct PCB* sibling_next;   // Next in the parent's children or zombies list
+    struct PCB* sibling_prev;
+    wait_queue_t child_exit;    // The process waits here for its children to exit
+    wait_queue_t* waiting_on;   // Queue the process is blocked on, if any
+    struct PCB* wait_next;      // Next in that queue
+    struct PCB* wait_prev;
+    ktimer_t wait_timer;        // Timeout of the current wait or sleep
+    int wait_timed_out;
 
     int exit_status;
-    bool is_new_child;
     uint64_t weight;     // scheduler weight (from priority or “nice”)
     uint64_t vruntime;   // cumulative virtual runtime
-    struct rb_node vr_node;  // node for the CFS tree
+    struct rb_node run_node; // node in the EDF, SJF or CFS run tree
+    uint64_t burst_estimate; // average TSC cycles run before blocking or yielding
+    uint64_t burst_cycles;   // TSC cycles run in the current burst so far
+    int mlfq_level;          // MLFQ: queue level, 0 is the top
+    uint32_t mlfq_used;      // MLFQ: ticks used of this level's quantum
+    struct sched_group* group;   // CPU bandwidth group, NULL if unlimited
+    struct vdso_proc* vdso;      // identity page mapped at VDSO_PROC, see vdso.h
     uint32_t* user_stack_base;    // User stack base
     uint32_t* kernel_stack_base;  // Kernel stack base
     uint32_t* kernel_stack_ptr;   // Current kernel stack pointer
+    arena_t* arena;               // Holds the PCB, kernel stack and other per-process kernel data
+    uint32_t runtime_ticks;       // Timer ticks spent running
+    uint32_t slice_ticks;         // Ticks left in the current time slice
+    uint64_t run_cycles;          // TSC cycles spent on the CPU
+    uint64_t wait_cycles;         // TSC cycles spent runnable, waiting for the CPU
+    uint64_t last_switch;         // TSC of being switched in, or of becoming runnable
+    uint64_t top_sample;          // run_cycles at the previous `top` refresh
+    uint32_t nvcsw;               // Switches away by blocking, yielding or exiting
+    uint32_t nivcsw;              // Switches away by preemption
+    uint32_t syscalls;            // System calls made
+    uint32_t dl_deadline;         // EDF: absolute tick the current job is due by
+    uint32_t dl_remaining;        // EDF: budget ticks left in this period
+    uint32_t dl_bw;               // EDF: reserved share of the CPU, see sched.c
+    int dl_throttled;             // EDF: out of budget until the next period
+    ktimer_t dl_timer;            // EDF: replenishes the budget at the deadline
+    uint32_t dl_misses;           // EDF: jobs finished after their deadline
+    uint32_t dl_lateness[DL_LATENESS_BUCKETS]; // EDF: jobs by ticks late: 0, 1, 2-3, 4-7, 8-15, 16+
 } PCB;
 
 extern PCB* process_table_head;  // Global linked list of all processes
 
+// One FIFO per priority level plus a bitmap of the non-empty levels, so
+// both enqueue and picking the most important process are constant time
 typedef struct {
-    PCB* front;
-    PCB* rear;
+    uint32_t bitmap[PRIO_BITMAP_WORDS];
+    PCB* front[PRIO_LEVELS];
+    PCB* rear[PRIO_LEVELS];
 } ProcessQueue;
 
 extern PCB* current_process;
+extern PCB idle_task;
 extern ProcessQueue ready_queue;
+extern volatile int need_resched;
 
 void initialize_queue(ProcessQueue* queue);
 bool is_queue_empty(ProcessQueue* queue);
 void enqueue_process(ProcessQueue* queue, PCB* process);
 PCB* dequeue_process(ProcessQueue* queue);
-void allocate_kernel_stack(PCB* process);
+int allocate_kernel_stack(PCB* process);
+
+PCB* process_alloc(void);
+void process_free(PCB* process);
+void process_table_add(PCB* process);
+void process_table_remove(PCB* process);
+PCB* process_find(uint32_t pid);
+void process_add_child(PCB* parent, PCB* child);
+void process_child_exited(PCB* child);
+void process_unlink_child(PCB* child);
+void process_defer_reap(PCB* process);
 
 void schedule(void);
+void irq_preempt(void);
+void switch_to(PCB* prev, PCB* next);
+int save_context(PCB* process) __attribute__((returns_twice));
+void context_switch_bench(void);
+
+#define PROCESS_STATS_PS  0     // table for the console
+#define PROCESS_STATS_TOP 1     // table with each process's CPU share since the previous call
+#define PROCESS_STATS_CSV 2     // one comma-separated record per process, for host-side tools
+
+void process_print_stats(void (*out)(const char*), int format);
 PCB* create_process(uint32_t pid, uint32_t* entry_point, int priority, int deadline, int time_to_run);
+PCB* create_user_process(uint32_t pid, const void* image, uint32_t size, uint32_t entry,
+                         int priority, int deadline, int time_to_run);
+void process_fault_exit(void);
 uint32_t get_new_pid(void);
 
 void init_process_management(void);
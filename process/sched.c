@@ -0,0 +1,881 @@
+#include "sched.h"
+#include "rbtree.h"
+#include "group.h"
+#include "../keyboard/io.h"
+#include "../keyboard/string.h"
+#include "../interrupts/timer.h"
+
+#define DEFAULT_NORM_WEIGHT 1024
+
+extern void debug_print(const char* messe);
+extern void debug_int(int val);
+extern void int_to_dec(uint32_t num, char *buffer);
+
+// Load weight for each nice level, -20..19. Every step is ~10% CPU, so
+// neighbouring levels differ by a factor of ~1.25; nice 0 is 1024.
+static const uint32_t nice_to_weight[PRIO_LEVELS] = {
+    88761, 71755, 56483, 46273, 36291,
+    29154, 23254, 18705, 14949, 11916,
+     9548,  7620,  6100,  4904,  3906,
+     3121,  2501,  1991,  1586,  1277,
+     1024,   820,   655,   526,   423,
+      335,   272,   215,   172,   137,
+      110,    87,    70,    56,    45,
+       36,    29,    23,    18,    15,
+};
+
+ProcessQueue ready_queue;
+volatile int need_resched = 0;
+int sched_default_policy = SCHED_POLICY_CFS;
+
+static uint64_t exec_start = 0;     // TSC when current_process was last charged
+
+static int priority_level(int priority) {
+    if (priority < PRIO_MIN) priority = PRIO_MIN;
+    if (priority > PRIO_MAX) priority = PRIO_MAX;
+    return priority - PRIO_MIN;
+}
+
+uint64_t priority_to_weight(int priority) {
+    return nice_to_weight[priority_level(priority)];
+}
+
+static uint32_t sched_period(void) {
+    uint32_t period = timer_frequency() * SCHED_TIMESLICE_MS / 1000;
+    return period ? period : 1;
+}
+
+static inline uint32_t bit_scan_forward(uint32_t word) {
+    uint32_t index;
+    asm("bsfl %1, %0" : "=r"(index) : "rm"(word));
+    return index;
+}
+
+// Most important non-empty level, or -1 if the queue is empty
+static int queue_top_level(ProcessQueue* queue) {
+    for (int i = 0; i < PRIO_BITMAP_WORDS; i++) {
+        if (queue->bitmap[i]) {
+            return i * 32 + (int)bit_scan_forward(queue->bitmap[i]);
+        }
+    }
+    return -1;
+}
+
+void initialize_queue(ProcessQueue* queue) {
+    for (int i = 0; i < PRIO_BITMAP_WORDS; i++) {
+        queue->bitmap[i] = 0;
+    }
+    for (int i = 0; i < PRIO_LEVELS; i++) {
+        queue->front[i] = NULL;
+        queue->rear[i] = NULL;
+    }
+}
+
+bool is_queue_empty(ProcessQueue* queue) {
+    return queue_top_level(queue) < 0;
+}
+
+// Appends to the tail of a level, so processes on the same level take turns
+static void queue_push(ProcessQueue* queue, int level, PCB* process) {
+    process->next = NULL;
+    if (queue->rear[level] == NULL) {
+        queue->front[level] = process;
+        queue->bitmap[level / 32] |= 1u << (level % 32);
+    } else {
+        queue->rear[level]->next = process;
+    }
+    queue->rear[level] = process;
+}
+
+void enqueue_process(ProcessQueue* queue, PCB* process) {
+    queue_push(queue, priority_level(process->priority), process);
+}
+
+PCB* dequeue_process(ProcessQueue* queue) {
+    int level = queue_top_level(queue);
+    if (level < 0) {
+        return NULL;
+    }
+
+    PCB* process = queue->front[level];
+    queue->front[level] = process->next;
+
+    if (queue->front[level] == NULL) {
+        queue->rear[level] = NULL;
+        queue->bitmap[level / 32] &= ~(1u << (level % 32));
+    }
+
+    process->next = NULL;
+    debug_print("DEBUG: Dequeued process has pid:");
+    debug_int(process->pid);
+    return process;
+}
+
+// Unlinks a process from the middle of its level; only a policy change needs this
+static void queue_remove(ProcessQueue* queue, int level, PCB* process) {
+    PCB* prev = NULL;
+    PCB* cur = queue->front[level];
+    while (cur != NULL && cur != process) {
+        prev = cur;
+        cur = cur->next;
+    }
+    if (cur == NULL) return;
+
+    if (prev == NULL) {
+        queue->front[level] = process->next;
+    } else {
+        prev->next = process->next;
+    }
+    if (queue->rear[level] == process) {
+        queue->rear[level] = prev;
+    }
+    if (queue->front[level] == NULL) {
+        queue->bitmap[level / 32] &= ~(1u << (level % 32));
+    }
+    process->next = NULL;
+}
+
+// EDF, SJF and CFS keep their processes in a red-black tree ordered by their own key
+typedef int (*run_less_t)(PCB* a, PCB* b);
+
+static void run_tree_insert(struct rb_root* root, PCB* process, run_less_t less) {
+    struct rb_node **link = &root->rb_node, *parent = NULL;
+    while (*link) {
+        PCB *q = rb_entry(*link, PCB, run_node);
+        parent = *link;
+        // Equal keys go right, so ties are served in arrival order
+        if (less(process, q))
+            link = &(*link)->rb_left;
+        else
+            link = &(*link)->rb_right;
+    }
+    rb_link_node(&process->run_node, parent, link);
+    rb_insert_color(&process->run_node, root);
+}
+
+static PCB* run_tree_first(struct rb_root* root) {
+    struct rb_node *n = rb_first(root);
+    return n ? rb_entry(n, PCB, run_node) : NULL;
+}
+
+static PCB* run_tree_pop(struct rb_root* root) {
+    PCB* process = run_tree_first(root);
+    if (process != NULL) {
+        rb_erase(&process->run_node, root);
+    }
+    return process;
+}
+
+// Preemptive classes switch as soon as a strictly better key is queued;
+// otherwise a used-up slice goes to the best waiting process if it is at
+// least as good, which round-robins among equal keys
+static void run_tree_tick(struct rb_root* root, PCB* process, run_less_t less, int preemptive) {
+    PCB* first = run_tree_first(root);
+    if (first != NULL) {
+        if (preemptive && less(first, process)) {
+            need_resched = 1;
+            return;
+        }
+        if (process->slice_ticks == 0 && !less(process, first)) {
+            need_resched = 1;
+            return;
+        }
+    }
+    if (process->slice_ticks == 0) {
+        process->slice_ticks = sched_period();
+    }
+}
+
+static uint32_t full_timeslice(PCB* process) {
+    (void)process;
+    return sched_period();
+}
+
+/* ---- CFS: weighted fair share by virtual runtime ---- */
+
+static struct rb_root cfs_rq = RB_ROOT;
+// Never moves backwards; new and woken processes are placed relative to it
+static uint64_t cfs_min_vruntime = 0;
+static uint64_t cfs_load = 0;       // summed weight of the processes in cfs_rq
+
+static int cfs_less(PCB* a, PCB* b) {
+    return a->vruntime < b->vruntime;
+}
+
+static void update_min_vruntime(void) {
+    uint64_t vruntime = cfs_min_vruntime;
+    PCB* leftmost = run_tree_first(&cfs_rq);
+    PCB* curr = current_process;
+    int running = curr != NULL && curr->state == STATE_RUNNING && curr->policy == SCHED_POLICY_CFS;
+
+    if (running) {
+        vruntime = curr->vruntime;
+    }
+    if (leftmost != NULL && (!running || leftmost->vruntime < vruntime)) {
+        vruntime = leftmost->vruntime;
+    }
+    if (vruntime > cfs_min_vruntime) {
+        cfs_min_vruntime = vruntime;
+    }
+}
+
+// Charges the TSC cycles since the last update to the process that ran them,
+// scaled by its weight: heavier processes accumulate vruntime more slowly.
+// One that has just blocked or exited pays for its last stretch too, but is
+// off the queue, so it doesn't move the minimum.
+static void update_curr(PCB* proc) {
+    uint64_t now = rdtsc();
+    uint64_t delta = now - exec_start;
+    exec_start = now;
+
+    proc->vruntime += delta * DEFAULT_NORM_WEIGHT / proc->weight;
+    if (proc->state == STATE_RUNNING) {
+        update_min_vruntime();
+    }
+}
+
+// New processes start level with the queue instead of at zero, which would
+// let them monopolise the CPU. Sleepers get back at most half a period of
+// credit, enough to run promptly after waking without starving anyone.
+static void place_process(PCB* process, int initial) {
+    uint64_t vruntime = cfs_min_vruntime;
+    if (!initial) {
+        uint64_t credit = timer_tsc_per_tick() * timer_frequency() * SCHED_TIMESLICE_MS / 2000;
+        vruntime = vruntime > credit ? vruntime - credit : 0;
+    }
+    if (process->vruntime < vruntime) {
+        process->vruntime = vruntime;
+    }
+}
+
+static void cfs_attach(PCB* process) {
+    place_process(process, 1);
+}
+
+static void cfs_enqueue(PCB* process, int wakeup) {
+    if (wakeup) {
+        place_process(process, 0);
+    }
+    cfs_load += process->weight;
+    run_tree_insert(&cfs_rq, process, cfs_less);
+}
+
+static void cfs_dequeue(PCB* process) {
+    rb_erase(&process->run_node, &cfs_rq);
+    cfs_load -= process->weight;
+}
+
+static PCB* cfs_pick_next(void) {
+    PCB* process = run_tree_pop(&cfs_rq);
+    if (process != NULL) {
+        cfs_load -= process->weight;
+    }
+    return process;
+}
+
+// The slice is the process's weighted share of one scheduling period
+static uint32_t cfs_timeslice(PCB* process) {
+    uint32_t slice = (uint32_t)(sched_period() * process->weight / (cfs_load + process->weight));
+    return slice ? slice : 1;
+}
+
+// Once the slice is used up, ask for a switch if someone has fallen behind in vruntime
+static void cfs_tick(PCB* process) {
+    update_curr(process);
+    if (process->slice_ticks == 0) {
+        PCB* leftmost = run_tree_first(&cfs_rq);
+        if (leftmost != NULL && leftmost->vruntime < process->vruntime) {
+            need_resched = 1;
+        } else {
+            process->slice_ticks = cfs_timeslice(process);
+        }
+    }
+}
+
+static void cfs_yield(PCB* process, int preempted) {
+    (void)preempted;
+    update_curr(process);
+}
+
+/* ---- PRIO: fixed priorities, round robin within a level ---- */
+
+static void prio_enqueue(PCB* process, int wakeup) {
+    (void)wakeup;
+    enqueue_process(&ready_queue, process);
+}
+
+static void prio_dequeue(PCB* process) {
+    queue_remove(&ready_queue, priority_level(process->priority), process);
+}
+
+static PCB* prio_pick_next(void) {
+    return dequeue_process(&ready_queue);
+}
+
+// A used-up slice only matters if another process of the same priority is waiting
+static void prio_tick(PCB* process) {
+    int top = queue_top_level(&ready_queue);
+    int level = priority_level(process->priority);
+    if (top >= 0 && (top < level || (top == level && process->slice_ticks == 0))) {
+        need_resched = 1;
+    } else if (process->slice_ticks == 0) {
+        process->slice_ticks = sched_period();
+    }
+}
+
+static int prio_preempts(PCB* waking, PCB* running) {
+    return waking->priority < running->priority;
+}
+
+/* ---- EDF: earliest deadline first, preemptive ---- */
+
+// Each process is a periodic task: every `deadline` ticks it may run for
+// `time_to_run` ticks, due by the end of the period. Admission keeps the
+// summed utilisation at or below one, which is what lets EDF meet every
+// deadline, and the tick enforces the budget so no task overruns into others.
+#define DL_BW_SHIFT 20
+#define DL_BW_ONE (1u << DL_BW_SHIFT)   // utilisation 1, i.e. the whole CPU
+
+static struct rb_root edf_rq = RB_ROOT;
+static uint32_t dl_total_bw = 0;        // summed dl_bw of the EDF processes
+
+static int edf_less(PCB* a, PCB* b) {
+    return (int32_t)(a->dl_deadline - b->dl_deadline) < 0;
+}
+
+static uint32_t dl_bandwidth(PCB* process) {
+    return (uint32_t)(((uint64_t)process->time_to_run << DL_BW_SHIFT) / (uint32_t)process->deadline);
+}
+
+static int edf_admit(PCB* process) {
+    if (process->deadline <= 0 || process->time_to_run <= 0 || process->time_to_run > process->deadline) {
+        return 0;
+    }
+    return dl_total_bw + dl_bandwidth(process) <= DL_BW_ONE;
+}
+
+static void dl_new_period(PCB* process) {
+    process->dl_deadline = timer_ticks + (uint32_t)process->deadline;
+    process->dl_remaining = (uint32_t)process->time_to_run;
+}
+
+// A job ends when it blocks or uses up its budget
+static void dl_job_done(PCB* process) {
+    int32_t late = (int32_t)(timer_ticks - process->dl_deadline);
+    int bucket = 0;
+    if (late > 0) {
+        process->dl_misses++;
+        for (bucket = 1; bucket < DL_LATENESS_BUCKETS - 1 && late >= (1 << bucket); bucket++);
+    }
+    process->dl_lateness[bucket]++;
+}
+
+// Timer callback at the deadline of a throttled job: the next period begins
+static void dl_replenish(void* data) {
+    PCB* process = (PCB*)data;
+    process->dl_deadline += (uint32_t)process->deadline;
+    process->dl_remaining = (uint32_t)process->time_to_run;
+    if (process->dl_throttled) {
+        process->dl_throttled = 0;
+        if (process->state == STATE_BLOCKED) {
+            sched_wakeup(process);
+        }
+    }
+}
+
+static void edf_attach(PCB* process) {
+    process->dl_bw = dl_bandwidth(process);
+    dl_total_bw += process->dl_bw;
+    process->dl_throttled = 0;
+    ktimer_init(&process->dl_timer, dl_replenish, process);
+    dl_new_period(process);
+}
+
+static void edf_detach(PCB* process) {
+    ktimer_cancel(&process->dl_timer);
+    dl_total_bw -= process->dl_bw;
+    process->dl_bw = 0;
+    process->dl_throttled = 0;
+}
+
+// A sleeper keeps its deadline only if the budget it has left still fits
+// before it at its reserved rate; otherwise it would eat into the others'
+// bandwidth, so it starts a fresh period instead
+static void edf_enqueue(PCB* process, int wakeup) {
+    if (wakeup) {
+        uint32_t left = process->dl_deadline - timer_ticks;
+        if ((int32_t)left <= 0
+                || (uint64_t)process->dl_remaining * (uint32_t)process->deadline
+                   > (uint64_t)left * (uint32_t)process->time_to_run) {
+            dl_new_period(process);
+        }
+    }
+    run_tree_insert(&edf_rq, process, edf_less);
+}
+
+static void edf_dequeue(PCB* process) {
+    rb_erase(&process->run_node, &edf_rq);
+}
+
+static PCB* edf_pick_next(void) {
+    return run_tree_pop(&edf_rq);
+}
+
+static void edf_tick(PCB* process) {
+    if (process->dl_remaining > 0) {
+        process->dl_remaining--;
+    }
+    if (process->dl_remaining == 0) {
+        dl_job_done(process);
+        if ((int32_t)(process->dl_deadline - timer_ticks) > 0) {
+            // Out of budget: sit out the rest of the period
+            process->dl_throttled = 1;
+            ktimer_arm(&process->dl_timer, process->dl_deadline);
+            need_resched = 1;
+            return;
+        }
+        dl_new_period(process);     // already late, so the next period starts now
+    }
+    run_tree_tick(&edf_rq, process, edf_less, 1);
+}
+
+static void edf_yield(PCB* process, int preempted) {
+    (void)preempted;
+    if (process->state != STATE_RUNNING && !process->dl_throttled) {
+        dl_job_done(process);
+    }
+}
+
+/* ---- SJF: shortest expected burst first, only switched at slice end ---- */
+
+static struct rb_root sjf_rq = RB_ROOT;
+
+// Bursts are learnt by sched_put_prev(), so nobody has to guess run times
+static int sjf_less(PCB* a, PCB* b) {
+    return a->burst_estimate < b->burst_estimate;
+}
+
+static void sjf_enqueue(PCB* process, int wakeup) {
+    (void)wakeup;
+    run_tree_insert(&sjf_rq, process, sjf_less);
+}
+
+static void sjf_dequeue(PCB* process) {
+    rb_erase(&process->run_node, &sjf_rq);
+}
+
+static PCB* sjf_pick_next(void) {
+    return run_tree_pop(&sjf_rq);
+}
+
+static void sjf_tick(PCB* process) {
+    run_tree_tick(&sjf_rq, process, sjf_less, 0);
+}
+
+/* ---- MLFQ: multi-level feedback queue ---- */
+
+// Using up the quantum of a level drops a process one level; giving up the
+// CPU with a burst estimate that fits the level above lifts it one level.
+// Interactive processes thus settle at the top with short quanta and
+// preempt CPU-bound ones, which sink to long quanta at the bottom.
+static ProcessQueue mlfq_queue;
+static uint32_t mlfq_next_boost = 0;
+
+static uint32_t mlfq_quantum(int level) {
+    uint32_t ticks = timer_ms_to_ticks(MLFQ_QUANTUM_MS << level);
+    return ticks ? ticks : 1;
+}
+
+// Every process back to the top level, oldest first
+static void mlfq_boost(void) {
+    for (int level = 1; level < MLFQ_LEVELS; level++) {
+        PCB* process;
+        while ((process = mlfq_queue.front[level]) != NULL) {
+            queue_remove(&mlfq_queue, level, process);
+            queue_push(&mlfq_queue, 0, process);
+        }
+    }
+    for (PCB* process = process_table_head; process != NULL; process = process->next_in_table) {
+        if (process->policy == SCHED_POLICY_MLFQ) {
+            process->mlfq_level = 0;
+            process->mlfq_used = 0;
+        }
+    }
+}
+
+static void mlfq_attach(PCB* process) {
+    process->mlfq_level = 0;
+    process->mlfq_used = 0;
+}
+
+static void mlfq_enqueue(PCB* process, int wakeup) {
+    (void)wakeup;
+    queue_push(&mlfq_queue, process->mlfq_level, process);
+}
+
+static void mlfq_dequeue(PCB* process) {
+    queue_remove(&mlfq_queue, process->mlfq_level, process);
+}
+
+static PCB* mlfq_pick_next(void) {
+    return dequeue_process(&mlfq_queue);
+}
+
+// Charged per tick, so a process can't keep its level by yielding just
+// before the quantum runs out
+static void mlfq_tick(PCB* process) {
+    if ((int32_t)(timer_ticks - mlfq_next_boost) >= 0) {
+        mlfq_next_boost = timer_ticks + timer_ms_to_ticks(MLFQ_BOOST_MS);
+        mlfq_boost();
+    }
+
+    process->mlfq_used++;
+    if (process->mlfq_used >= mlfq_quantum(process->mlfq_level)) {
+        if (process->mlfq_level < MLFQ_LEVELS - 1) {
+            process->mlfq_level++;
+        }
+        process->mlfq_used = 0;
+    }
+    int top = queue_top_level(&mlfq_queue);
+    if (top >= 0 && (top < process->mlfq_level || (top == process->mlfq_level && process->mlfq_used == 0))) {
+        need_resched = 1;
+    }
+}
+
+static void mlfq_yield(PCB* process, int preempted) {
+    if (preempted || process->mlfq_level == 0) {
+        return;
+    }
+    uint64_t quantum = timer_tsc_per_tick() * mlfq_quantum(process->mlfq_level - 1);
+    if (process->burst_estimate <= quantum) {
+        process->mlfq_level--;
+        process->mlfq_used = 0;
+    }
+}
+
+static uint32_t mlfq_timeslice(PCB* process) {
+    return mlfq_quantum(process->mlfq_level) - process->mlfq_used;
+}
+
+static int mlfq_preempts(PCB* waking, PCB* running) {
+    return waking->mlfq_level < running->mlfq_level;
+}
+
+/* ---- class table ---- */
+
+static const sched_class_t sched_classes[SCHED_NUM_POLICIES] = {
+    [SCHED_POLICY_CFS] = {
+        .name = "cfs", .rank = 4,
+        .admit = NULL, .attach = cfs_attach, .detach = NULL, .enqueue = cfs_enqueue, .dequeue = cfs_dequeue,
+        .pick_next = cfs_pick_next, .tick = cfs_tick, .yield = cfs_yield,
+        .timeslice = cfs_timeslice, .preempts = NULL,
+    },
+    [SCHED_POLICY_PRIO] = {
+        .name = "prio", .rank = 1,
+        .admit = NULL, .attach = NULL, .detach = NULL, .enqueue = prio_enqueue, .dequeue = prio_dequeue,
+        .pick_next = prio_pick_next, .tick = prio_tick, .yield = NULL,
+        .timeslice = full_timeslice, .preempts = prio_preempts,
+    },
+    [SCHED_POLICY_EDF] = {
+        .name = "edf", .rank = 0,
+        .admit = edf_admit, .attach = edf_attach, .detach = edf_detach,
+        .enqueue = edf_enqueue, .dequeue = edf_dequeue,
+        .pick_next = edf_pick_next, .tick = edf_tick, .yield = edf_yield,
+        .timeslice = full_timeslice, .preempts = edf_less,
+    },
+    [SCHED_POLICY_SJF] = {
+        .name = "sjf", .rank = 2,
+        .admit = NULL, .attach = NULL, .detach = NULL, .enqueue = sjf_enqueue, .dequeue = sjf_dequeue,
+        .pick_next = sjf_pick_next, .tick = sjf_tick, .yield = NULL,
+        .timeslice = full_timeslice, .preempts = NULL,
+    },
+    [SCHED_POLICY_MLFQ] = {
+        .name = "mlfq", .rank = 3,
+        .admit = NULL, .attach = mlfq_attach, .detach = NULL,
+        .enqueue = mlfq_enqueue, .dequeue = mlfq_dequeue,
+        .pick_next = mlfq_pick_next, .tick = mlfq_tick, .yield = mlfq_yield,
+        .timeslice = mlfq_timeslice, .preempts = mlfq_preempts,
+    },
+};
+
+// Policies in the order pick_next tries them, i.e. by rank
+static const int sched_class_order[SCHED_NUM_POLICIES] = {
+    SCHED_POLICY_EDF, SCHED_POLICY_PRIO, SCHED_POLICY_SJF, SCHED_POLICY_MLFQ, SCHED_POLICY_CFS,
+};
+
+static const sched_class_t* class_of(PCB* process) {
+    return &sched_classes[process->policy];
+}
+
+// Queues a process with its class and asks for a switch if it should run
+// before whatever is on the CPU right now
+static void sched_enqueue(PCB* process, int wakeup) {
+    if (group_throttled(process)) {
+        group_park(process);
+        return;
+    }
+
+    const sched_class_t* class = class_of(process);
+    process->state = STATE_READY;
+    process->last_switch = rdtsc();
+    class->enqueue(process, wakeup);
+
+    PCB* running = current_process;
+    if (running == &idle_task) {
+        // A sleeper whose event arrived takes over from the CLI; newly
+        // queued processes still wait for `process start`
+        if (wakeup) need_resched = 1;
+        return;
+    }
+    if (running == process || running->state != STATE_RUNNING) return;
+
+    const sched_class_t* running_class = class_of(running);
+    if (class->rank < running_class->rank
+            || (class == running_class && class->preempts != NULL && class->preempts(process, running))) {
+        need_resched = 1;
+    }
+}
+
+void sched_add_new(PCB* process) {
+    uint32_t flags = irq_save();
+    const sched_class_t* class = class_of(process);
+    if (class->admit != NULL && !class->admit(process)) {
+        // Every process is admitted somewhere: CFS takes anyone
+        debug_print("DEBUG: Admission refused, falling back to cfs for pid:");
+        debug_int(process->pid);
+        process->policy = SCHED_POLICY_CFS;
+        class = class_of(process);
+    }
+    if (class->attach != NULL) {
+        class->attach(process);
+    }
+    sched_enqueue(process, 0);
+    irq_restore(flags);
+}
+
+void sched_wakeup(PCB* process) {
+    uint32_t flags = irq_save();
+    sched_enqueue(process, 1);
+    irq_restore(flags);
+}
+
+// Called by schedule() with interrupts off for the process giving up the
+// CPU. A burst lasts until the process gives the CPU up itself.
+void sched_put_prev(PCB* process, int preempted) {
+    uint64_t ran = rdtsc() - process->last_switch;
+    process->run_cycles += ran;
+    if (process == &idle_task) return;
+
+    process->burst_cycles += ran;
+    group_charge(process, ran);
+    if (!preempted) {
+        process->burst_estimate += (process->burst_cycles >> BURST_AVG_SHIFT)
+                                 - (process->burst_estimate >> BURST_AVG_SHIFT);
+        process->burst_cycles = 0;
+    }
+
+    const sched_class_t* class = class_of(process);
+    if (class->yield != NULL) {
+        class->yield(process, preempted);
+    }
+    if (process->state == STATE_EXIT || process->state == STATE_ZOMBIE) {
+        if (class->detach != NULL) {
+            class->detach(process);
+        }
+        group_attach(process, NULL);
+    } else if (process->state == STATE_RUNNING) {
+        if (process->dl_throttled) {
+            process->state = STATE_BLOCKED;     // woken by dl_replenish()
+        } else {
+            sched_enqueue(process, 0);
+        }
+    }
+}
+
+PCB* sched_pick_next(void) {
+    for (int i = 0; i < SCHED_NUM_POLICIES; i++) {
+        PCB* process;
+        while ((process = sched_classes[sched_class_order[i]].pick_next()) != NULL) {
+            if (!group_throttled(process)) {
+                return process;
+            }
+            // Queued before its group ran out of quota
+            group_park(process);
+        }
+    }
+    return NULL;
+}
+
+void sched_start(PCB* process) {
+    uint64_t now = rdtsc();
+    if (process != &idle_task) {
+        process->wait_cycles += now - process->last_switch;
+        process->state = STATE_RUNNING;
+        process->slice_ticks = class_of(process)->timeslice(process);
+    }
+    process->last_switch = now;
+    need_resched = 0;
+    exec_start = now;
+}
+
+// Timer interrupt: charge the running process a tick and let its class
+// decide whether someone else should have the CPU
+void sched_tick(void) {
+    PCB* proc = current_process;
+    if (proc == &idle_task || proc->state != STATE_RUNNING) return;
+
+    proc->runtime_ticks++;
+    if (proc->slice_ticks > 0) {
+        proc->slice_ticks--;
+    }
+    if (group_over_quota(proc, rdtsc() - proc->last_switch)) {
+        need_resched = 1;       // sched_put_prev() parks it
+        return;
+    }
+    class_of(proc)->tick(proc);
+}
+
+int sched_set_process_policy(PCB* process, int policy) {
+    if (policy < 0 || policy >= SCHED_NUM_POLICIES) {
+        return -1;
+    }
+
+    if (process->state == STATE_EXIT || process->state == STATE_ZOMBIE) {
+        return -1;
+    }
+
+    uint32_t flags = irq_save();
+    if (process->policy != policy) {
+        const sched_class_t* class = &sched_classes[policy];
+        if (class->admit != NULL && !class->admit(process)) {
+            irq_restore(flags);
+            return -1;
+        }
+
+        const sched_class_t* old_class = class_of(process);
+        int queued = process->state == STATE_READY;
+        int throttled = process->state == STATE_BLOCKED && process->dl_throttled;
+        if (queued) {
+            old_class->dequeue(process);
+        }
+        if (old_class->detach != NULL) {
+            old_class->detach(process);
+        }
+        process->policy = policy;
+        if (class->attach != NULL) {
+            class->attach(process);
+        }
+        if (queued || throttled) {
+            sched_enqueue(process, throttled);
+        } else if (process == current_process && process->state == STATE_RUNNING) {
+            need_resched = 1;
+        }
+    }
+    irq_restore(flags);
+    return 0;
+}
+
+// Changes an EDF task's period and budget, or moves the process to EDF with
+// them. Fails, leaving everything as it was, if admission refuses them.
+int sched_set_deadline(PCB* process, uint32_t period, uint32_t budget) {
+    if (period == 0 || period > 0x7FFFFFFF || budget == 0 || budget > period) {
+        return -1;
+    }
+
+    uint32_t flags = irq_save();
+    int old_period = process->deadline;
+    int old_budget = process->time_to_run;
+    process->deadline = (int)period;
+    process->time_to_run = (int)budget;
+
+    int result = 0;
+    if (process->policy != SCHED_POLICY_EDF) {
+        result = sched_set_process_policy(process, SCHED_POLICY_EDF);
+    } else {
+        // Already admitted: only the change in bandwidth has to fit. The
+        // current period runs out as it was.
+        uint32_t bw = dl_bandwidth(process);
+        if (dl_total_bw - process->dl_bw + bw > DL_BW_ONE) {
+            result = -1;
+        } else {
+            dl_total_bw = dl_total_bw - process->dl_bw + bw;
+            process->dl_bw = bw;
+        }
+    }
+    if (result != 0) {
+        process->deadline = old_period;
+        process->time_to_run = old_budget;
+    }
+    irq_restore(flags);
+    return result;
+}
+
+// Switches every existing process and makes the policy the default for new
+// ones. Returns how many processes the class refused to admit.
+int sched_set_policy(int policy) {
+    if (policy < 0 || policy >= SCHED_NUM_POLICIES) {
+        return -1;
+    }
+
+    int refused = 0;
+    uint32_t flags = irq_save();
+    sched_default_policy = policy;
+    for (PCB* process = process_table_head; process != NULL; process = process->next_in_table) {
+        if (process->state != STATE_EXIT && process->state != STATE_ZOMBIE
+                && sched_set_process_policy(process, policy) != 0) {
+            refused++;
+        }
+    }
+    irq_restore(flags);
+    return refused;
+}
+
+static void out_dec(void (*out)(const char*), uint32_t value) {
+    char buffer[16];
+    int_to_dec(value, buffer);
+    out(buffer);
+}
+
+// Utilisation, then one line per EDF process with its deadline misses and
+// lateness histogram
+void sched_print_dl_stats(void (*out)(const char*)) {
+    uint32_t flags = irq_save();
+    out("EDF utilisation: ");
+    out_dec(out, (uint32_t)(((uint64_t)dl_total_bw * 100 + DL_BW_ONE / 2) >> DL_BW_SHIFT));
+    out("%\n  PID PERIOD BUDGET  MISSES  LATE 0/1/2-3/4-7/8-15/16+\n");
+    for (PCB* process = process_table_head; process != NULL; process = process->next_in_table) {
+        if (process->policy != SCHED_POLICY_EDF || process->dl_bw == 0) {
+            continue;
+        }
+        out("  ");
+        out_dec(out, process->pid);
+        out("  ");
+        out_dec(out, (uint32_t)process->deadline);
+        out("  ");
+        out_dec(out, (uint32_t)process->time_to_run);
+        out("  ");
+        out_dec(out, process->dl_misses);
+        out("  ");
+        for (int i = 0; i < DL_LATENESS_BUCKETS; i++) {
+            out_dec(out, process->dl_lateness[i]);
+            out(i < DL_LATENESS_BUCKETS - 1 ? "/" : "\n");
+        }
+    }
+    irq_restore(flags);
+}
+
+int sched_policy_from_name(const char* name) {
+    for (int i = 0; i < SCHED_NUM_POLICIES; i++) {
+        if (strcmp(name, sched_classes[i].name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char* sched_policy_name(int policy) {
+    if (policy < 0 || policy >= SCHED_NUM_POLICIES) {
+        return "?";
+    }
+    return sched_classes[policy].name;
+}
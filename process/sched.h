@@ -0,0 +1,65 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include "process.h"
+
+#define SCHED_POLICY_CFS  0
+#define SCHED_POLICY_PRIO 1
+#define SCHED_POLICY_EDF  2
+#define SCHED_POLICY_SJF  3
+#define SCHED_POLICY_MLFQ 4
+#define SCHED_NUM_POLICIES 5
+
+// MLFQ: level n gets a quantum of MLFQ_QUANTUM_MS << n; every level is
+// boosted back to the top once per MLFQ_BOOST_MS so nothing starves
+#define MLFQ_LEVELS 4
+#define MLFQ_QUANTUM_MS 10
+#define MLFQ_BOOST_MS 1000
+
+// EDF period and budget, in ticks, for processes the CLI starts: a tenth of
+// the CPU each, so several are admitted before the total would pass 100%
+#define SCHED_DL_PERIOD 10
+#define SCHED_DL_BUDGET 1
+
+// CPU bursts are estimated as est = est * (1 - a) + burst * a, a = 1/2^shift
+#define BURST_AVG_SHIFT 1
+
+// A scheduler class owns the run queue of every process using its policy.
+// schedule() only talks to the classes through these callbacks.
+typedef struct sched_class {
+    const char* name;
+    int rank;                                   // lower ranks always run first
+    int (*admit)(PCB* process);                 // optional: may the process join the class?
+    void (*attach)(PCB* process);               // process joins the class (new, forked or moved)
+    void (*detach)(PCB* process);               // optional: process leaves the class or exits
+    void (*enqueue)(PCB* process, int wakeup);  // make runnable; wakeup is set after blocking
+    void (*dequeue)(PCB* process);              // remove a runnable process from the queue
+    PCB* (*pick_next)(void);                    // remove and return the best runnable process
+    void (*tick)(PCB* process);                 // timer tick charged to the running process
+    void (*yield)(PCB* process, int preempted); // running process is leaving the CPU
+    uint32_t (*timeslice)(PCB* process);        // ticks to give a process being switched in
+    int (*preempts)(PCB* waking, PCB* running); // optional: should waking run before running?
+} sched_class_t;
+
+extern int sched_default_policy;
+
+void sched_add_new(PCB* process);
+void sched_wakeup(PCB* process);
+void sched_tick(void);
+
+// Used by schedule() around the switch
+void sched_put_prev(PCB* process, int preempted);
+PCB* sched_pick_next(void);
+void sched_start(PCB* process);
+
+int sched_set_policy(int policy);
+int sched_set_process_policy(PCB* process, int policy);
+int sched_set_deadline(PCB* process, uint32_t period, uint32_t budget);
+void sched_print_dl_stats(void (*out)(const char*));
+int sched_policy_from_name(const char* name);
+const char* sched_policy_name(int policy);
+
+uint64_t priority_to_weight(int priority);
+
+#endif // SCHED_H
@@ -0,0 +1,71 @@
+; switch.asm
+[bits 32]
+global switch_to
+global save_context
+extern kernel_tss
+
+; Offsets into the PCB, which starts with its cpu_context_t (see process.h)
+%define CTX_EBX     0
+%define CTX_ESI     4
+%define CTX_EDI     8
+%define CTX_EBP     12
+%define CTX_ESP     16
+%define CTX_EIP     20
+%define CTX_EFLAGS  24
+%define PCB_CR3     28
+%define TSS_CR3     28
+
+; Stores the caller's callee-saved registers, EFLAGS and the point it
+; returns to into the PCB in EAX. Clobbers ECX.
+%macro SAVE_CONTEXT 0
+    mov [eax+CTX_EBX], ebx
+    mov [eax+CTX_ESI], esi
+    mov [eax+CTX_EDI], edi
+    mov [eax+CTX_EBP], ebp
+    mov ecx, [esp]              ; return address
+    mov [eax+CTX_EIP], ecx
+    lea ecx, [esp+4]            ; ESP once we have returned
+    mov [eax+CTX_ESP], ecx
+    pushfd
+    pop dword [eax+CTX_EFLAGS]
+%endmacro
+
+; void switch_to(PCB* prev, PCB* next)
+; Parks prev and resumes next wherever its context was saved. Returns when
+; prev is switched back in. Must be called with interrupts off.
+switch_to:
+    mov eax, [esp+4]            ; prev
+    mov edx, [esp+8]            ; next
+    SAVE_CONTEXT
+
+    ; CR3 and ESP change back to back: the old stack may not be mapped in the
+    ; new address space. kernel_tss.cr3 follows CR3 so a page fault task
+    ; returns into the right address space.
+    mov ecx, [edx+PCB_CR3]
+    mov eax, cr3
+    cmp eax, ecx
+    je .same_space
+    mov cr3, ecx
+    mov [kernel_tss+TSS_CR3], ecx
+.same_space:
+    mov ebx, [edx+CTX_EBX]
+    mov esi, [edx+CTX_ESI]
+    mov edi, [edx+CTX_EDI]
+    mov ebp, [edx+CTX_EBP]
+    mov esp, [edx+CTX_ESP]
+    push dword [edx+CTX_EIP]
+    push dword [edx+CTX_EFLAGS]
+    xor eax, eax
+    popfd                       ; EFLAGS last, so interrupts stay off until the new stack is in place
+    ret
+
+; int save_context(PCB* process)
+; Records the caller in process the way switch_to parks a process: the first
+; switch into it returns from this call a second time, with 0. Returns 1 now.
+save_context:
+    mov eax, [esp+4]
+    SAVE_CONTEXT
+    mov eax, 1
+    ret
+
+section .note.GNU-stack
@@ -0,0 +1,145 @@
+; syscall.asm
+[bits 32]
+global syscall_int80_stub
+global sysenter_entry
+global syscall_return
+global user_bench_start, user_bench_end
+global user_bench_int80, user_bench_sysenter
+global user_bench_vdso_getpid, user_bench_vdso_clock
+extern syscall_dispatch
+extern irq_preempt
+extern kernel_tss
+
+%define KERNEL_DATA_SEL 0x10            ; selectors must match gdt.h
+%define USER_CODE_SEL   0x1B            ; GDT_USER_CODE | GDT_RPL_USER
+%define USER_DATA_SEL   0x23            ; GDT_USER_DATA | GDT_RPL_USER
+%define TSS_ESP0        4
+%define EFLAGS_IF       0x200
+
+%define USER_CODE_BASE  0x40000000      ; must match paging.h
+%define SYS_EXIT        1               ; must match syscall.h
+%define SYS_GETPID      6
+%define SYSCALL_BENCH_CALLS 10000
+%define VDSO_TEXT       0xBFC02000      ; must match vdso.h
+%define VDSO_SLOT_SIZE  8
+%define VDSO_SLOT_GETPID   0
+%define VDSO_SLOT_CLOCK_NS 3
+
+; Builds the rest of a trap_frame_t (see syscall.h) under the iret frame
+; and moves to the kernel's data segments, whatever ring 3 left in them
+%macro SAVE_FRAME 0
+    pusha
+    push ds
+    push es
+    mov ax, KERNEL_DATA_SEL
+    mov ds, ax
+    mov es, ax
+    cld
+%endmacro
+
+; int 0x80 arrives through a trap gate: on the kernel stack from the TSS,
+; with the CPU's iret frame already in place and interrupts still on
+syscall_int80_stub:
+    SAVE_FRAME
+    push esp                    ; trap_frame_t*
+    call syscall_dispatch
+    add esp, 4
+    cli
+    call irq_preempt            ; a wakeup may have made someone more urgent
+; A new ring 3 process and a forked child start here, on a frame of their own
+syscall_return:
+    pop es
+    pop ds
+    popa
+    iretd
+
+; sysenter leaves only CS, SS, ESP and EIP set, from the MSRs, with
+; interrupts off. The caller passes its ESP in ECX and where to resume in
+; EDX; with an iret frame made of those the trap frame looks the same as
+; for int 0x80, so fork and preemption needn't tell the two apart.
+sysenter_entry:
+    mov esp, [ss:kernel_tss + TSS_ESP0]
+    push dword USER_DATA_SEL
+    push ecx                    ; user ESP
+    pushfd
+    or dword [esp], EFLAGS_IF   ; as ring 3 had them
+    push dword USER_CODE_SEL
+    push edx                    ; user EIP
+    SAVE_FRAME
+    sti
+    push esp
+    call syscall_dispatch
+    add esp, 4
+    cli
+    call irq_preempt
+    pop es
+    pop ds
+    popa
+    mov edx, [esp]              ; EIP from the frame
+    mov ecx, [esp+12]           ; ESP from the frame
+    sti                         ; takes effect after sysexit, on the user stack
+    sysexit
+
+; Ring 3 program behind `bench syscall`, copied to USER_CODE_BASE. It times
+; SYSCALL_BENCH_CALLS calls to getpid through one entry path, or to one of
+; the vDSO helpers that avoid the kernel, and exits with the average cycles
+; per call. Everything it does is relative to
+; USER_CODE_BASE, never to where the kernel image holds it.
+user_bench_start:
+
+user_bench_int80:
+    mov ebp, SYSCALL_BENCH_CALLS
+    rdtsc
+    mov esi, eax
+.loop:
+    mov eax, SYS_GETPID
+    int 0x80
+    dec ebp
+    jnz .loop
+    jmp user_bench_exit
+
+user_bench_sysenter:
+    mov ebp, SYSCALL_BENCH_CALLS
+    rdtsc
+    mov esi, eax
+.loop:
+    mov eax, SYS_GETPID
+    mov ecx, esp
+    mov edx, USER_CODE_BASE + (.resume - user_bench_start)
+    sysenter
+.resume:
+    dec ebp
+    jnz .loop
+    jmp user_bench_exit
+
+user_bench_vdso_getpid:
+    mov edi, VDSO_TEXT + VDSO_SLOT_GETPID * VDSO_SLOT_SIZE
+    jmp user_bench_vdso
+
+user_bench_vdso_clock:
+    mov edi, VDSO_TEXT + VDSO_SLOT_CLOCK_NS * VDSO_SLOT_SIZE
+
+; EDI holds the helper to call; the helpers keep EBP, ESI and EDI
+user_bench_vdso:
+    mov ebp, SYSCALL_BENCH_CALLS
+    rdtsc
+    mov esi, eax
+.loop:
+    call edi
+    dec ebp
+    jnz .loop
+
+; ESI holds the low half of the TSC at the start
+user_bench_exit:
+    rdtsc
+    sub eax, esi
+    xor edx, edx
+    mov ecx, SYSCALL_BENCH_CALLS
+    div ecx
+    mov ebx, eax
+    mov eax, SYS_EXIT
+    int 0x80
+
+user_bench_end:
+
+section .note.GNU-stack
@@ -1,98 +1,162 @@
 #include "syscall.h"
 #include "process.h"
+#include "sched.h"
+#include "group.h"
+#include "vdso.h"
 #include "../memory/memory.h"
+#include "../memory/paging.h"
+#include "../keyboard/io.h"
+#include "../keyboard/gdt.h"
+#include "../keyboard/string.h"
+#include "../interrupts/idt.h"
+
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+#define CPUID_SEP (1 << 11)     // leaf 1 EDX: SYSENTER/SYSEXIT
+
+#define WRITE_CHUNK 64
 
 extern void debug_print(const char* messe);
 extern void print_to_screen(const char* message);
 extern void debug_int(int val);
-extern void kfree(void* ptr);
+extern void int_to_dec(uint32_t num, char *buffer);
+
+extern void syscall_int80_stub(void);
+extern void sysenter_entry(void);
+extern uint8_t user_bench_start[], user_bench_end[];
+extern uint8_t user_bench_int80[], user_bench_sysenter[];
+extern uint8_t user_bench_vdso_getpid[], user_bench_vdso_clock[];
+
+bool sysenter_supported = false;
+
+// sysenter_entry() moves to the process's kernel stack straight away; this
+// one only has to hold whatever might interrupt it before that
+static uint8_t sysenter_stack[256] __attribute__((aligned(16)));
 
 PCB* get_current_process(void) {
     return current_process;
 }
 
-static PCB* find_zombie_child(PCB* parent) {
-    debug_print("DEBUG: Searching for zombie child of parent with pid:");
-    debug_int(parent->pid);
-    PCB* current = process_table_head;
-    PCB* prev = NULL;
-    while (current != NULL) {
-        if (current->parent->pid == parent->pid && current->state == STATE_ZOMBIE) {
-            debug_print("DEBUG: Found zombie child");
-            if (prev == NULL) {
-                process_table_head = current->next_in_table;
-            } else {
-                prev->next_in_table = current->next_in_table;
-            }
-            
-            return current;
-        }
-        
-        prev = current;
-        current = current->next_in_table;
+static void reap_process(PCB* proc) {
+    process_free(proc);
+}
+
+// The child's PCB and empty address space, scheduling parameters as the parent's
+static PCB* fork_alloc(PCB* parent) {
+    PCB* child = process_alloc();
+    if (child == NULL) {
+        debug_print("DEBUG: Fork failed - memory allocation error");
+        return NULL;
     }
     
-    return NULL;
+    child->pid = get_new_pid();
+    child->priority = parent->priority;
+    child->deadline = parent->deadline;
+    child->time_to_run = parent->time_to_run;
+    child->policy = parent->policy;
+    child->weight = parent->weight;
+    child->vruntime = parent->vruntime;
+    child->burst_estimate = parent->burst_estimate;
+    child->cr3 = paging_create_directory();
+    if (child->cr3 == 0) {
+        debug_print("DEBUG: Fork failed - page table allocation error");
+        process_free(child);
+        return NULL;
+    }
+    return child;
 }
 
-int fork_syscall(void) {
-    uint32_t* stack_ptr;
+// Parent and child share the user pages copy-on-write from here on
+static int fork_copy(PCB* parent, PCB* child) {
+    if (copy_page_tables(parent->cr3, child->cr3) != 0) {
+        debug_print("DEBUG: Fork failed - stack allocation error");
+        process_free(child);
+        return -1;
+    }
+    // The vDSO identity page came along with the rest; the child needs its own
+    if (vdso_map(child) != 0) {
+        debug_print("DEBUG: Fork failed - vDSO allocation error");
+        process_free(child);
+        return -1;
+    }
+    if (allocate_kernel_stack(child) != 0) {
+        debug_print("DEBUG: Fork failed - kernel stack allocation error");
+        process_free(child);
+        return -1;
+    }
+
+    // The child's copy of the stack lives at the same virtual address, so no pointer fix-ups
+    child->user_stack_base = parent->user_stack_base;
+    return 0;
+}
 
-    __asm__ volatile(
-        "lea (%%ebp), %0\n\t" 
-        : "=r" (stack_ptr)
-    );
+static int fork_start(PCB* parent, PCB* child) {
+    uint32_t flags = irq_save();
+    process_table_add(child);
+    process_add_child(parent, child);
+    group_attach(child, parent->group);
+    sched_add_new(child);
+    irq_restore(flags);
+    
+    debug_print("DEBUG: Fork created new process with PID:");
+    debug_int(child->pid);
+    return child->pid;
+}
 
+int fork_syscall(void) {
     debug_print("DEBUG: Fork syscall started");
     PCB* parent = get_current_process();
     if (parent == NULL) {
         debug_print("DEBUG: Fork failed - no current process");
         return -1;
     }
+    parent->syscalls++;
 
-    parent->user_stack_ptr = stack_ptr;
-    PCB* child = (PCB*)kmalloc(sizeof(PCB));
+    PCB* child = fork_alloc(parent);
     if (child == NULL) {
-        debug_print("DEBUG: Fork failed - memory allocation error");
         return -1;
     }
-    
-    child->pid = get_new_pid();
-    child->parent = parent;
-    child->priority = parent->priority;
-    uint32_t* child_stack_base = (uint32_t*)kmalloc(4096);
-    if (child_stack_base == NULL) {
-        debug_print("DEBUG: Fork failed - stack allocation error");
+    // The child starts out from here, with the registers and flags we have
+    // now; its copy of the stack is taken below, after this frame is final
+    if (save_context(child) == 0) {
+        return 0;
+    }
+    if (fork_copy(parent, child) != 0) {
         return -1;
     }
+    return fork_start(parent, child);
+}
 
-    uint32_t stack_offset = (uint32_t)parent->user_stack_ptr - (uint32_t)parent->user_stack_base;
-    copy_memory(child_stack_base, parent->user_stack_base, 4096);
-    child->user_stack_ptr = (uint32_t*)((uint32_t)child_stack_base + stack_offset);
-    if (parent->cr3 != 0) {
-        child->cr3 = (uint32_t)kmalloc(4096);
-        if (child->cr3 == 0) {
-            debug_print("DEBUG: Fork failed - page table allocation error");
-            return -1;  
-        }
-        copy_page_tables(parent->cr3, child->cr3);
+// Fork for a ring 3 caller, which is in the kernel on a stack of its own that
+// the child can't share. The child gets a copy of just the trap frame and
+// returns to ring 3 through it, with 0 in EAX.
+static int user_fork(trap_frame_t* frame) {
+    debug_print("DEBUG: Fork syscall started");
+    PCB* parent = get_current_process();
+    parent->syscalls++;
+
+    PCB* child = fork_alloc(parent);
+    if (child == NULL || fork_copy(parent, child) != 0) {
+        return -1;
     }
 
-    child->kernel_stack_base = (uint32_t*)kmalloc(KERNEL_STACK_SIZE);
-    child->kernel_stack_ptr = child->kernel_stack_base + (KERNEL_STACK_SIZE/sizeof(uint32_t));
-    
-    child->state = STATE_READY;
-    child->is_new_child = true;
-    child->next_in_table = process_table_head;
-    process_table_head = child;
-    enqueue_process(&ready_queue, child);
-    
-    debug_print("DEBUG: Fork created new process with PID:");
-    debug_int(child->pid);
-    return child->pid;
+    trap_frame_t* child_frame = (trap_frame_t*)child->kernel_stack_ptr - 1;
+    *child_frame = *frame;
+    child_frame->eax = 0;
+    child->context.esp = (uint32_t)child_frame;
+    child->context.eip = (uint32_t)syscall_return;
+    child->context.eflags = EFLAGS_DEFAULT & ~EFLAGS_IF;
+    return fork_start(parent, child);
 }
 
 int wait_syscall(int* status) {
+    return waitpid_syscall(-1, status, 0);
+}
+
+// pid -1 waits for any child. Returns the reaped child's pid, 0 if WNOHANG
+// is set and nothing has exited yet, or -1 if there is no such child.
+int waitpid_syscall(int pid, int* status, int options) {
     debug_print("DEBUG: Wait syscall started");
 
     PCB* parent = get_current_process();
@@ -100,44 +164,56 @@ int wait_syscall(int* status) {
         debug_print("DEBUG: Wait failed - no current process");
         return -1;
     }
-    PCB* zombie_child = find_zombie_child(parent);
-    if (zombie_child != NULL) {
-        if (status != NULL) {
-            *status = zombie_child->exit_status;
+    parent->syscalls++;
+
+    // Interrupts stay off between checking and blocking, or a child exiting
+    // in between would never wake us; wait_queue_sleep() hands them back off.
+    uint32_t flags = irq_save();
+    PCB* zombie_child;
+    while (1) {
+        if (pid == -1) {
+            if (parent->children == NULL && parent->zombies == NULL) {
+                irq_restore(flags);
+                debug_print("DEBUG: Wait failed - no children");
+                return -1;
+            }
+            zombie_child = parent->zombies;
+        } else {
+            zombie_child = process_find((uint32_t)pid);
+            if (zombie_child == NULL || zombie_child->parent != parent) {
+                irq_restore(flags);
+                debug_print("DEBUG: Wait failed - not a child");
+                return -1;
+            }
+            if (zombie_child->state != STATE_ZOMBIE) {
+                zombie_child = NULL;
+            }
+        }
+        if (zombie_child != NULL) {
+            break;
+        }
+        if (options & WNOHANG) {
+            irq_restore(flags);
+            return 0;
         }
-        
-        int child_pid = zombie_child->pid;
-        kfree(zombie_child);
 
-        return child_pid;
+        debug_print("DEBUG: Wait syscall blocking process with PID:");
+        debug_int(parent->pid);
+        wait_queue_sleep(&parent->child_exit, WAIT_FOREVER);
+        debug_print("DEBUG: Wait syscall resumed for process with PID:");
+        debug_int(parent->pid);
     }
 
-    debug_print("DEBUG: No existing zombie children found. Blocking parent.");
-    parent->state = STATE_BLOCKED;
-    
-    debug_print("DEBUG: Wait syscall going to schedule a process after blocking process with PID:");
-    debug_int(parent->pid);
-    yield_syscall();
-
-    debug_print("DEBUG: Wait syscall resumed after blocking for the process with PID:");
-    debug_int(parent->pid);
-    
-    zombie_child = find_zombie_child(parent);
-    if (zombie_child != NULL) {
-        if (status != NULL) {
-            *status = zombie_child->exit_status;
-        }
-        
-        int child_pid = zombie_child->pid;
-        
-        kfree(zombie_child);
+    process_unlink_child(zombie_child);
+    process_table_remove(zombie_child);
+    irq_restore(flags);
 
-        return child_pid;
+    if (status != NULL) {
+        *status = zombie_child->exit_status;
     }
-    
-    debug_print("DEBUG: Wait failed - no children found after blocking");
-
-    return -1;
+    int child_pid = zombie_child->pid;
+    reap_process(zombie_child);
+    return child_pid;
 }
 
 void exit_syscall(int status) {
@@ -150,14 +226,30 @@ void exit_syscall(int status) {
         debug_print("DEBUG: Exit failed - no current process");
         return;
     }
+    proc->syscalls++;
     debug_print("DEBUG: Exiting process with PID:");
     debug_int(proc->pid);
 
+    // Never resumes, so nothing to restore
+    asm volatile("cli");
+
     proc->exit_status = status;
-    proc->state = STATE_ZOMBIE;
-    if (proc->parent != NULL && proc->parent->state == STATE_BLOCKED) {
-        proc->parent->state = STATE_READY;
-        enqueue_process(&ready_queue, proc->parent);
+
+    // Nobody is left to wait for our children: zombies go now, the rest when they exit
+    while (proc->zombies != NULL) {
+        PCB* child = proc->zombies;
+        process_unlink_child(child);
+        process_defer_reap(child);
+    }
+    while (proc->children != NULL) {
+        process_unlink_child(proc->children);
+    }
+
+    if (proc->parent == NULL) {
+        process_defer_reap(proc);
+    } else {
+        process_child_exited(proc);
+        wait_queue_wake_all(&proc->parent->child_exit);
     }
     schedule();
     
@@ -166,33 +258,199 @@ void exit_syscall(int status) {
 }
 
 void yield_syscall(void) {
-    uint32_t* stack_ptr;
-    
-    __asm__ volatile(
-        "lea (%%ebp), %0\n\t"
-        : "=r" (stack_ptr)
-    );
-
     PCB* proc = get_current_process();
     if (proc == NULL) {
         debug_print("DEBUG: Yield failed - no current process");
         return;
     }
+    proc->syscalls++;
     
     debug_print("DEBUG: Process yielding CPU has PID:");
     debug_int(proc->pid);
 
-    proc->user_stack_ptr = stack_ptr;
-
-    asm volatile (
-        "movl %0, %%esp\n\t"  
-        :
-        : "r" (proc->kernel_stack_ptr)
-    );
     schedule();
-    debug_print("DEBUG: Yield syscall - should not reach here");
+}
+
+// Blocks the caller for at least ms milliseconds; 0 just yields
+int sleep_syscall(uint32_t ms) {
+    PCB* proc = get_current_process();
+    if (proc == NULL) {
+        debug_print("DEBUG: Sleep failed - no current process");
+        return -1;
+    }
+    proc->syscalls++;
+    if (ms == 0) {
+        schedule();
+        return 0;
+    }
+
+    uint32_t flags = irq_save();
+    wait_queue_sleep(NULL, ms);
+    irq_restore(flags);
+    return 0;
+}
+
+// Whether ring 3 may reach [addr, addr + size): the user half only, every
+// page mapped or swapped out, and writable, perhaps after a copy, if write
+// is set. Touching it from the kernel then faults at most in a way the page
+// fault task can fix up.
+static bool user_access_ok(uint32_t addr, uint32_t size, bool write) {
+    if (addr < USER_SPACE_START || addr + size < addr) return false;
+
+    uint32_t dir = get_current_process()->cr3;
+    for (uint32_t page = addr & PTE_FRAME_MASK; page < addr + size; page += PAGE_SIZE) {
+        uint32_t* pte = paging_get_pte(dir, page, 0);
+        if (pte == NULL || !(*pte & (PTE_PRESENT | PTE_SWAPPED)) || !(*pte & PTE_USER)) {
+            return false;
+        }
+        if (write && !(*pte & (PTE_WRITE | PTE_COW))) {
+            return false;
+        }
+        if (page == PTE_FRAME_MASK) break;      // the last page; the next one would wrap
+    }
+    return true;
+}
+
+static int sys_exit(trap_frame_t* frame) {
+    exit_syscall((int)frame->ebx);
+    return 0;
+}
+
+static int sys_fork(trap_frame_t* frame) {
+    return user_fork(frame);
+}
+
+static int sys_waitpid(trap_frame_t* frame) {
+    uint32_t status_addr = frame->esi;
+    if (status_addr != 0 && !user_access_ok(status_addr, sizeof(int), true)) {
+        return -1;
+    }
+    int status = 0;
+    int pid = waitpid_syscall((int)frame->ebx, &status, (int)frame->edi);
+    if (pid > 0 && status_addr != 0) {
+        *(int*)status_addr = status;
+    }
+    return pid;
+}
+
+static int sys_yield(trap_frame_t* frame) {
+    (void)frame;
+    yield_syscall();
+    return 0;
+}
+
+static int sys_sleep(trap_frame_t* frame) {
+    return sleep_syscall(frame->ebx);
+}
+
+static int sys_getpid(trap_frame_t* frame) {
+    (void)frame;
+    PCB* proc = get_current_process();
+    proc->syscalls++;
+    return (int)proc->pid;
+}
+
+static int sys_write(trap_frame_t* frame) {
+    uint32_t buffer = frame->ebx;
+    uint32_t length = frame->esi;
+    if (!user_access_ok(buffer, length, false)) {
+        return -1;
+    }
+    get_current_process()->syscalls++;
+
+    char chunk[WRITE_CHUNK + 1];
+    for (uint32_t done = 0; done < length; done += WRITE_CHUNK) {
+        uint32_t n = length - done < WRITE_CHUNK ? length - done : WRITE_CHUNK;
+        memcpy(chunk, (const char*)buffer + done, n);
+        chunk[n] = '\0';
+        print_to_screen(chunk);
+    }
+    return (int)length;
+}
+
+typedef int (*syscall_fn_t)(trap_frame_t* frame);
+
+static const syscall_fn_t syscall_table[SYSCALL_COUNT] = {
+    [SYS_EXIT]    = sys_exit,
+    [SYS_FORK]    = sys_fork,
+    [SYS_WAITPID] = sys_waitpid,
+    [SYS_YIELD]   = sys_yield,
+    [SYS_SLEEP]   = sys_sleep,
+    [SYS_GETPID]  = sys_getpid,
+    [SYS_WRITE]   = sys_write,
+};
+
+// Called by both entry stubs, interrupts on. The result goes back in EAX.
+void syscall_dispatch(trap_frame_t* frame) {
+    uint32_t number = frame->eax;
+    if (number >= SYSCALL_COUNT || syscall_table[number] == NULL) {
+        frame->eax = (uint32_t)-1;
+        return;
+    }
+    frame->eax = (uint32_t)syscall_table[number](frame);
+}
+
+// Runs one copy of the ring 3 bench program as a child of the CLI and
+// returns what it exits with: the average cycles per call, or -1
+static int bench_run(uint8_t* entry) {
+    uint32_t flags = irq_save();
+    PCB* process = create_user_process(get_new_pid(), user_bench_start,
+                                       (uint32_t)(user_bench_end - user_bench_start),
+                                       (uint32_t)(entry - user_bench_start), 1,
+                                       SCHED_DL_PERIOD, SCHED_DL_BUDGET);
+    if (process == NULL) {
+        irq_restore(flags);
+        return -1;
+    }
+    // Ours to reap, so it can't be freed before we have read its status
+    process_add_child(&idle_task, process);
+    int pid = (int)process->pid;
+    irq_restore(flags);
+
+    int status = -1;
+    while (waitpid_syscall(pid, &status, WNOHANG) == 0) {
+        schedule();
+    }
+    return status;
+}
+
+static void bench_print(const char* name, int cycles) {
+    char buffer[16];
+    print_to_screen(name);
+    if (cycles < 0) {
+        print_to_screen("failed\n");
+        return;
+    }
+    int_to_dec((uint32_t)cycles, buffer);
+    print_to_screen(buffer);
+    print_to_screen(" cycles per call\n");
+}
+
+// Times a null system call (getpid) from ring 3 through each entry path,
+// and the vDSO's getpid and clock, which don't enter the kernel at all
+void syscall_bench(void) {
+    bench_print("int 0x80 getpid: ", bench_run(user_bench_int80));
+    if (sysenter_supported) {
+        bench_print("sysenter getpid: ", bench_run(user_bench_sysenter));
+    } else {
+        print_to_screen("sysenter getpid: not supported by this CPU\n");
+    }
+    bench_print("vDSO getpid: ", bench_run(user_bench_vdso_getpid));
+    bench_print("vDSO clock: ", bench_run(user_bench_vdso_clock));
 }
 
 void init_syscalls(void) {
+    // A trap gate, so a long system call stays preemptible, with DPL 3 so
+    // ring 3 may raise it
+    idt_set_gate(SYSCALL_VECTOR, (uint32_t)syscall_int80_stub, GDT_KERNEL_CODE, 0xEF);
+
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (edx & CPUID_SEP) {
+        wrmsr(MSR_SYSENTER_CS, GDT_KERNEL_CODE);
+        wrmsr(MSR_SYSENTER_ESP, (uint32_t)(sysenter_stack + sizeof(sysenter_stack)));
+        wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+        sysenter_supported = true;
+    }
     debug_print("DEBUG: System calls initialized");
 }
@@ -2,10 +2,45 @@
 #define SYSCALL_H
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#define SYSCALL_VECTOR 0x80
+
+// Numbers ring 3 passes in EAX, through int 0x80 or sysenter alike.
+// Arguments go in EBX, ESI and EDI, since sysenter takes the return ESP and
+// EIP in ECX and EDX; the result comes back in EAX.
+#define SYS_EXIT     1      // status
+#define SYS_FORK     2
+#define SYS_WAITPID  3      // pid, int* status, options
+#define SYS_YIELD    4
+#define SYS_SLEEP    5      // ms
+#define SYS_GETPID   6
+#define SYS_WRITE    7      // const char* buffer, length: to the screen
+#define SYSCALL_COUNT 8
+
+// A ring 3 caller's registers as the entry stubs in syscall.asm save them on
+// its kernel stack, lowest address first. Both entry paths end the frame the
+// way an interrupt from ring 3 does, so iret can always return through it.
+typedef struct trap_frame {
+    uint32_t es, ds;
+    uint32_t edi, esi, ebp, esp_unused, ebx, edx, ecx, eax;    // pusha
+    uint32_t eip, cs, eflags, user_esp, user_ss;
+} trap_frame_t;
+
+extern bool sysenter_supported;
+
+void syscall_dispatch(trap_frame_t* frame);
+void syscall_return(void);      // pops a trap frame and irets; in syscall.asm
+void syscall_bench(void);
+
 int fork_syscall(void);
+#define WNOHANG 1   // waitpid: return 0 instead of blocking when no child has exited
+
 int wait_syscall(int* status);
+int waitpid_syscall(int pid, int* status, int options);
 void exit_syscall(int status);
 void yield_syscall(void);
+int sleep_syscall(uint32_t ms);
 void init_syscalls(void);
 
-#endif
\ No newline at end of file
+#endif
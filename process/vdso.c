@@ -0,0 +1,113 @@
+#include <stddef.h>
+#include "vdso.h"
+#include "process.h"
+#include "../memory/memory.h"
+#include "../memory/paging.h"
+#include "../keyboard/io.h"
+#include "../keyboard/string.h"
+#include "../interrupts/timer.h"
+
+extern void debug_print(const char* messe);
+
+extern uint8_t vdso_text_start[], vdso_text_end[];
+
+// vdso_text.asm reads the pages at these addresses and offsets
+_Static_assert(VDSO_BASE == 0xBFC00000, "vdso_text.asm expects the vDSO at 0xBFC00000");
+_Static_assert(offsetof(vdso_data_t, seq) == 0, "vdso_text.asm expects seq at 0");
+_Static_assert(offsetof(vdso_data_t, ticks) == 4, "vdso_text.asm expects ticks at 4");
+_Static_assert(offsetof(vdso_data_t, ns_per_tick) == 12, "vdso_text.asm expects ns_per_tick at 12");
+_Static_assert(offsetof(vdso_data_t, ns_mult) == 16, "vdso_text.asm expects ns_mult at 16");
+_Static_assert(offsetof(vdso_data_t, tick_tsc) == 24, "vdso_text.asm expects tick_tsc at 24");
+_Static_assert(offsetof(vdso_data_t, ns_base) == 32, "vdso_text.asm expects ns_base at 32");
+_Static_assert(offsetof(vdso_proc_t, ppid) == 4, "vdso_text.asm expects ppid at 4");
+
+// Both pages are shared by every address space; the kernel keeps a reference
+// of its own to each, so they are never freed or swapped out
+static vdso_data_t* vdso_data = NULL;
+static uint8_t* vdso_text = NULL;
+static uint64_t calibrated_tsc_per_tick = 0;
+
+#define vdso_barrier() asm volatile("" : : : "memory")
+
+// Before any process exists, once the timer runs
+void vdso_init(void) {
+    vdso_data = (vdso_data_t*)allocate_pages(1);
+    vdso_text = (uint8_t*)allocate_pages(1);
+    if (vdso_data == NULL || vdso_text == NULL) {
+        debug_print("DEBUG: vDSO pages allocation failed");
+        return;
+    }
+    memcpy(vdso_text, vdso_text_start, (size_t)(vdso_text_end - vdso_text_start));
+
+    vdso_data->frequency = timer_frequency();
+    vdso_data->ns_per_tick = 1000000000u / vdso_data->frequency;
+    vdso_update_clock(timer_ticks, rdtsc(), timer_tsc_per_tick());
+    debug_print("DEBUG: vDSO initialized");
+}
+
+static int map_page(uint32_t dir, uint32_t virt, void* page) {
+    page_get(page);
+    if (paging_map(dir, virt, (uint32_t)page, PTE_USER) != 0) {
+        page_put(page);
+        return -1;
+    }
+    return 0;
+}
+
+// Maps the vDSO into a new address space, or over the one a forked child
+// shares with its parent, and gives the process an identity page of its own
+int vdso_map(PCB* process) {
+    if (vdso_data == NULL) return 0;
+
+    uint32_t dir = process->cr3;
+    for (uint32_t virt = VDSO_BASE; virt < VDSO_BASE + VDSO_PAGES * PAGE_SIZE; virt += PAGE_SIZE) {
+        uint32_t old = paging_unmap(dir, virt);
+        if (old != 0) {
+            page_put((void*)old);
+        }
+    }
+
+    vdso_proc_t* proc = (vdso_proc_t*)allocate_pages(1);
+    if (proc == NULL) return -1;
+    if (map_page(dir, VDSO_DATA, vdso_data) != 0
+            || map_page(dir, VDSO_TEXT, vdso_text) != 0
+            || map_page(dir, VDSO_PROC, proc) != 0) {
+        free_pages(proc);
+        return -1;
+    }
+    // allocate_pages()' reference is the kernel's: it writes the page directly
+    process->vdso = proc;
+    vdso_update_process(process);
+    return 0;
+}
+
+// After the address space is gone
+void vdso_release(PCB* process) {
+    if (process->vdso != NULL) {
+        page_put(process->vdso);
+        process->vdso = NULL;
+    }
+}
+
+void vdso_update_process(PCB* process) {
+    if (process->vdso == NULL) return;
+    process->vdso->pid = process->pid;
+    process->vdso->ppid = process->parent != NULL ? process->parent->pid : 0;
+}
+
+// From the timer interrupt, once timer_ticks and the TSC at the tick are final
+void vdso_update_clock(uint32_t ticks, uint64_t tick_tsc, uint64_t tsc_per_tick) {
+    if (vdso_data == NULL) return;
+
+    vdso_data->seq++;
+    vdso_barrier();
+    if (tsc_per_tick != calibrated_tsc_per_tick) {
+        calibrated_tsc_per_tick = tsc_per_tick;
+        vdso_data->ns_mult = (uint32_t)(((uint64_t)vdso_data->ns_per_tick << VDSO_NS_SHIFT) / tsc_per_tick);
+    }
+    vdso_data->ticks = ticks;
+    vdso_data->tick_tsc = tick_tsc;
+    vdso_data->ns_base = (uint64_t)ticks * 1000000000u / vdso_data->frequency;
+    vdso_barrier();
+    vdso_data->seq++;
+}
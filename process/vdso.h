@@ -0,0 +1,73 @@
+#ifndef VDSO_H
+#define VDSO_H
+
+#include <stdint.h>
+#include "../memory/paging.h"
+
+// Pages the kernel maps read-only into every address space, so a process
+// can learn its identity and the time without entering the kernel:
+//  - data: the clock, one page shared by everyone and updated every tick
+//  - proc: the process's own identity
+//  - text: the helpers below, which read the other two
+#define VDSO_DATA (VDSO_BASE)
+#define VDSO_PROC (VDSO_BASE + PAGE_SIZE)
+#define VDSO_TEXT (VDSO_BASE + 2 * PAGE_SIZE)
+#define VDSO_PAGES 3
+
+// The text page starts with a jump table, one slot per helper. Each helper
+// is cdecl: callable from C and from ring 3 alike, EBX, ESI, EDI and EBP kept.
+#define VDSO_SLOT_SIZE       8
+#define VDSO_SLOT_GETPID     0      // uint32_t (void)
+#define VDSO_SLOT_GETPPID    1      // uint32_t (void)
+#define VDSO_SLOT_TICKS      2      // uint32_t (void): timer_ticks
+#define VDSO_SLOT_CLOCK_NS   3      // uint64_t (void): nanoseconds since boot
+#define VDSO_SLOT_ADDR(slot) (VDSO_TEXT + (slot) * VDSO_SLOT_SIZE)
+
+#define VDSO_NS_SHIFT 24            // ns = TSC cycles * ns_mult >> VDSO_NS_SHIFT
+
+// Written under a seqlock: seq is odd while an update is under way, and a
+// reader retries if it changed. Ticks are the reference; between two of
+// them the TSC interpolates, never past the next tick's ns_base. The layout
+// is spelled out in vdso_text.asm too.
+typedef struct vdso_data {
+    volatile uint32_t seq;
+    uint32_t ticks;
+    uint32_t frequency;     // ticks per second
+    uint32_t ns_per_tick;
+    uint32_t ns_mult;       // 0 until the TSC is calibrated
+    uint32_t reserved;
+    uint64_t tick_tsc;      // TSC at the last tick
+    uint64_t ns_base;       // nanoseconds since boot at the last tick
+} vdso_data_t;
+
+typedef struct vdso_proc {
+    uint32_t pid;
+    uint32_t ppid;          // 0 once orphaned
+} vdso_proc_t;
+
+struct PCB;
+
+void vdso_init(void);
+int vdso_map(struct PCB* process);
+void vdso_release(struct PCB* process);
+void vdso_update_process(struct PCB* process);
+void vdso_update_clock(uint32_t ticks, uint64_t tick_tsc, uint64_t tsc_per_tick);
+
+// The helpers, for C running in any process's address space
+static inline uint32_t vdso_getpid(void) {
+    return ((uint32_t (*)(void))VDSO_SLOT_ADDR(VDSO_SLOT_GETPID))();
+}
+
+static inline uint32_t vdso_getppid(void) {
+    return ((uint32_t (*)(void))VDSO_SLOT_ADDR(VDSO_SLOT_GETPPID))();
+}
+
+static inline uint32_t vdso_ticks(void) {
+    return ((uint32_t (*)(void))VDSO_SLOT_ADDR(VDSO_SLOT_TICKS))();
+}
+
+static inline uint64_t vdso_clock_ns(void) {
+    return ((uint64_t (*)(void))VDSO_SLOT_ADDR(VDSO_SLOT_CLOCK_NS))();
+}
+
+#endif
@@ -0,0 +1,83 @@
+; vdso_text.asm
+; The vDSO helpers. vdso_init() copies this to the text page, which every
+; address space maps at VDSO_TEXT, so the code only uses relative jumps and
+; the fixed addresses of the data and proc pages. See vdso.h.
+[bits 32]
+global vdso_text_start, vdso_text_end
+
+%define VDSO_BASE       0xBFC00000      ; must match paging.h and vdso.h
+%define VDSO_DATA       VDSO_BASE
+%define VDSO_PROC       (VDSO_BASE + 0x1000)
+%define VDSO_NS_SHIFT   24
+
+; vdso_data_t
+%define DATA_SEQ         (VDSO_DATA + 0)
+%define DATA_TICKS       (VDSO_DATA + 4)
+%define DATA_NS_PER_TICK (VDSO_DATA + 12)
+%define DATA_NS_MULT     (VDSO_DATA + 16)
+%define DATA_TICK_TSC    (VDSO_DATA + 24)
+%define DATA_NS_BASE     (VDSO_DATA + 32)
+
+; vdso_proc_t
+%define PROC_PID        (VDSO_PROC + 0)
+%define PROC_PPID       (VDSO_PROC + 4)
+
+%macro SLOT 1
+    jmp near %1
+    align 8, db 0xCC
+%endmacro
+
+vdso_text_start:
+    SLOT vdso_getpid            ; VDSO_SLOT_GETPID
+    SLOT vdso_getppid           ; VDSO_SLOT_GETPPID
+    SLOT vdso_ticks             ; VDSO_SLOT_TICKS
+    SLOT vdso_clock_ns          ; VDSO_SLOT_CLOCK_NS
+
+vdso_getpid:
+    mov eax, [PROC_PID]
+    ret
+
+vdso_getppid:
+    mov eax, [PROC_PPID]
+    ret
+
+; A single aligned load, so no need for the seqlock
+vdso_ticks:
+    mov eax, [DATA_TICKS]
+    ret
+
+; Returns nanoseconds since boot in EDX:EAX. The kernel moves tick_tsc
+; forward every tick, so the low half of the TSC delta is all there is.
+vdso_clock_ns:
+    push esi
+.retry:
+    mov esi, [DATA_SEQ]
+    test esi, 1
+    jz .read
+    pause                       ; an update is under way
+    jmp .retry
+.read:
+    rdtsc
+    sub eax, [DATA_TICK_TSC]
+    mul dword [DATA_NS_MULT]
+    shrd eax, edx, VDSO_NS_SHIFT
+    shr edx, VDSO_NS_SHIFT
+    mov ecx, [DATA_NS_PER_TICK]
+    test edx, edx               ; at most one tick on from ns_base, so the
+    jnz .clamp                  ; clock never runs ahead of the next one
+    cmp eax, ecx
+    jbe .add
+.clamp:
+    mov eax, ecx
+.add:
+    xor edx, edx
+    add eax, [DATA_NS_BASE]
+    adc edx, [DATA_NS_BASE + 4]
+    cmp esi, [DATA_SEQ]
+    jne .retry
+    pop esi
+    ret
+
+vdso_text_end:
+
+section .note.GNU-stack
@@ -0,0 +1,111 @@
+#include <stddef.h>
+#include "wait.h"
+#include "process.h"
+#include "sched.h"
+#include "../keyboard/io.h"
+#include "../interrupts/timer.h"
+
+void wait_queue_init(wait_queue_t* queue) {
+    queue->head = NULL;
+    queue->tail = NULL;
+}
+
+// Callers hold interrupts off while adding or removing
+void wait_queue_add(wait_queue_t* queue, PCB* process) {
+    process->wait_next = NULL;
+    process->wait_prev = queue->tail;
+    if (queue->tail != NULL) {
+        queue->tail->wait_next = process;
+    } else {
+        queue->head = process;
+    }
+    queue->tail = process;
+    process->waiting_on = queue;
+}
+
+void wait_queue_remove(wait_queue_t* queue, PCB* process) {
+    if (process->waiting_on != queue) return;
+    if (process->wait_prev != NULL) {
+        process->wait_prev->wait_next = process->wait_next;
+    } else {
+        queue->head = process->wait_next;
+    }
+    if (process->wait_next != NULL) {
+        process->wait_next->wait_prev = process->wait_prev;
+    } else {
+        queue->tail = process->wait_prev;
+    }
+    process->wait_next = NULL;
+    process->wait_prev = NULL;
+    process->waiting_on = NULL;
+}
+
+// The timeout goes too: once woken, the wait has not timed out, however long
+// the process then waits for the CPU
+static void wake_process(wait_queue_t* queue, PCB* process) {
+    wait_queue_remove(queue, process);
+    ktimer_cancel(&process->wait_timer);
+    if (process->state == STATE_BLOCKED) {
+        sched_wakeup(process);
+    }
+}
+
+// Returns 1 if a process was woken
+int wait_queue_wake_one(wait_queue_t* queue) {
+    uint32_t flags = irq_save();
+    PCB* process = queue->head;
+    if (process != NULL) {
+        wake_process(queue, process);
+    }
+    irq_restore(flags);
+    return process != NULL;
+}
+
+// Returns how many processes were woken
+int wait_queue_wake_all(wait_queue_t* queue) {
+    int woken = 0;
+    uint32_t flags = irq_save();
+    while (queue->head != NULL) {
+        wake_process(queue, queue->head);
+        woken++;
+    }
+    irq_restore(flags);
+    return woken;
+}
+
+static void wait_timeout(void* data) {
+    PCB* process = (PCB*)data;
+    if (process->waiting_on != NULL) {
+        process->wait_timed_out = 1;
+        wake_process(process->waiting_on, process);
+    } else if (process->state == STATE_BLOCKED) {
+        process->wait_timed_out = 1;
+        sched_wakeup(process);
+    }
+}
+
+// Blocks the current process on queue, or just for timeout_ms if queue is
+// NULL. Call it with interrupts off, after finding that the condition being
+// waited for doesn't hold yet, so a wakeup can't slip in between; they are
+// off again on return. Returns 0 when woken and -1 on timeout.
+int wait_queue_sleep(wait_queue_t* queue, uint32_t timeout_ms) {
+    PCB* process = current_process;
+    if (process == &idle_task) {
+        return -1;      // the idle task must stay runnable
+    }
+
+    process->wait_timed_out = 0;
+    if (queue != NULL) {
+        wait_queue_add(queue, process);
+    }
+    if (timeout_ms != WAIT_FOREVER) {
+        // One tick extra: the current tick is already partly over
+        ktimer_init(&process->wait_timer, wait_timeout, process);
+        ktimer_arm(&process->wait_timer, timer_ticks + timer_ms_to_ticks(timeout_ms) + 1);
+    }
+    process->state = STATE_BLOCKED;
+    schedule();
+
+    ktimer_cancel(&process->wait_timer);
+    return process->wait_timed_out ? -1 : 0;
+}
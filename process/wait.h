@@ -0,0 +1,23 @@
+#ifndef WAIT_H
+#define WAIT_H
+
+#include <stdint.h>
+
+#define WAIT_FOREVER 0          // timeout_ms value for waits without a timeout
+
+struct PCB;
+
+// FIFO of blocked processes, linked through their PCBs
+typedef struct wait_queue {
+    struct PCB* head;
+    struct PCB* tail;
+} wait_queue_t;
+
+void wait_queue_init(wait_queue_t* queue);
+void wait_queue_add(wait_queue_t* queue, struct PCB* process);
+void wait_queue_remove(wait_queue_t* queue, struct PCB* process);
+int wait_queue_wake_one(wait_queue_t* queue);
+int wait_queue_wake_all(wait_queue_t* queue);
+int wait_queue_sleep(wait_queue_t* queue, uint32_t timeout_ms);
+
+#endif
@@ -7,16 +7,29 @@ nasm -f elf32 interrupts/idt.asm             -o bin/idt_asm.o
 nasm -f elf32 interrupts/exceptions.asm      -o bin/exceptions.o
 nasm -f elf32 interrupts/irq.asm             -o bin/irq_asm.o
 nasm -f elf32 keyboard/gdt.asm               -o bin/gdt.o
+nasm -f elf32 process/switch.asm             -o bin/switch.o
+nasm -f elf32 process/syscall.asm            -o bin/syscall_asm.o
+nasm -f elf32 process/vdso_text.asm          -o bin/vdso_text.o
+nasm -f elf32 test_processes/user_test.asm   -o bin/user_test.o
 
 echo "Compiling C files..."
 gcc -m32 -ffreestanding -c kernel.c                    -o bin/kernel.o
 gcc -m32 -ffreestanding -c serial.c                    -o bin/serial.o
 gcc -m32 -ffreestanding -c memory/memory.c             -o bin/memory.o
+gcc -m32 -ffreestanding -c memory/slab.c               -o bin/slab.o
+gcc -m32 -ffreestanding -c memory/paging.c             -o bin/paging.o
+gcc -m32 -ffreestanding -c memory/arena.c              -o bin/arena.o
+gcc -m32 -ffreestanding -c memory/compress.c           -o bin/compress.o
+gcc -m32 -ffreestanding -c memory/swap.c               -o bin/swap.o
 gcc -m32 -ffreestanding -c filesystem/filesystem.c     -o bin/filesystem.o
 
 echo "Compiling process support & red–black tree..."
 gcc -m32 -ffreestanding -c process/process.c           -o bin/process.o
 gcc -m32 -ffreestanding -c process/syscall.c           -o bin/syscall.o
+gcc -m32 -ffreestanding -c process/sched.c             -o bin/sched.o
+gcc -m32 -ffreestanding -c process/wait.c              -o bin/wait.o
+gcc -m32 -ffreestanding -c process/group.c             -o bin/group.o
+gcc -m32 -ffreestanding -c process/vdso.c              -o bin/vdso.o
 gcc -m32 -ffreestanding -c process/rbtree.c            -o bin/rbtree.o
 
 echo "Compiling keyboard & helpers..."
@@ -29,6 +42,8 @@ echo "Compiling interrupt handlers..."
 gcc -m32 -ffreestanding -c interrupts/idt.c            -o bin/idt.o
 gcc -m32 -ffreestanding -c interrupts/pic.c            -o bin/pic.o
 gcc -m32 -ffreestanding -c interrupts/interrupts.c     -o bin/interrupts.o
+gcc -m32 -ffreestanding -c interrupts/timer.c          -o bin/timer.o
+gcc -m32 -ffreestanding -c interrupts/timer_wheel.c    -o bin/timer_wheel.o
 
 echo "Compiling test processes..."
 gcc -m32 -ffreestanding -c test_processes/dummy1.c     -o bin/dummy1.o
@@ -44,11 +59,12 @@ gcc -m32 -nostdlib \
     bin/boot.o \
     bin/idt_asm.o bin/exceptions.o bin/irq_asm.o \
     bin/kernel.o bin/serial.o \
-    bin/memory.o bin/filesystem.o \
-    bin/process.o bin/syscall.o bin/rbtree.o \
+    bin/memory.o bin/slab.o bin/paging.o bin/arena.o bin/compress.o bin/swap.o \
+    bin/filesystem.o \
+    bin/process.o bin/syscall.o bin/sched.o bin/wait.o bin/group.o bin/vdso.o bin/rbtree.o bin/switch.o bin/syscall_asm.o bin/vdso_text.o \
     bin/keyboard.o bin/io.o bin/string.o bin/gdt.o bin/gdt_c.o \
-    bin/idt.o bin/pic.o bin/interrupts.o \
-    bin/dummy1.o bin/dummy2.o bin/dummy3.o bin/process_test.o bin/syscall_test.o \
+    bin/idt.o bin/pic.o bin/interrupts.o bin/timer.o bin/timer_wheel.o \
+    bin/dummy1.o bin/dummy2.o bin/dummy3.o bin/process_test.o bin/syscall_test.o bin/user_test.o \
     -lgcc
 
 echo "Setting up GRUB boot structure..."
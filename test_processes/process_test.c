@@ -1,6 +1,7 @@
 #include "../process/process.h"
 #include "../memory/memory.h"
 #include "../process/syscall.h"
+#include "../process/sched.h"
 
 extern void debug_print(const char* messe);
 extern void print_to_screen(const char* message);
@@ -98,6 +99,17 @@ void test_queue_operations(void) {
         debug_print("DEBUG: Queue should be empty after dequeuing - FAIL");
     }
     
+    p2->priority = 0;
+    enqueue_process(&test_queue, p1);
+    enqueue_process(&test_queue, p2);
+    dequeued = dequeue_process(&test_queue);
+    if (dequeued == p2 && dequeue_process(&test_queue) == p1) {
+        debug_print("DEBUG: Higher priority dequeued first - PASS");
+    } else {
+        debug_print("DEBUG: Priority order wrong - FAIL");
+    }
+    p2->priority = 1;
+    
     debug_print("DEBUG: Queue operations test complete");
 }
 
@@ -129,6 +141,38 @@ void test_process_creation(void) {
     debug_print("DEBUG: Process creation test complete");
 }
 
+void test_edf_admission(void) {
+    debug_print("DEBUG: Testing EDF admission");
+
+    PCB* p1 = create_process(get_new_pid(), (uint32_t*)test_process_3, 1, 2, 3);
+    PCB* p2 = create_process(get_new_pid(), (uint32_t*)test_process_3, 1, 2, 3);
+    if (p1 == NULL || p2 == NULL) {
+        debug_print("DEBUG: EDF admission test could not create processes - FAIL");
+        return;
+    }
+
+    if (sched_set_deadline(p1, 10, 5) == 0 && p1->policy == SCHED_POLICY_EDF) {
+        debug_print("DEBUG: Half the CPU admitted - PASS");
+    } else {
+        debug_print("DEBUG: Half the CPU refused - FAIL");
+    }
+    if (sched_set_deadline(p2, 10, 6) != 0 && p2->policy != SCHED_POLICY_EDF) {
+        debug_print("DEBUG: Over-subscription refused - PASS");
+    } else {
+        debug_print("DEBUG: Over-subscription admitted - FAIL");
+    }
+    if (sched_set_deadline(p2, 20, 10) == 0) {
+        debug_print("DEBUG: Exactly full CPU admitted - PASS");
+    } else {
+        debug_print("DEBUG: Exactly full CPU refused - FAIL");
+    }
+
+    // Give the bandwidth back for whatever runs next
+    sched_set_process_policy(p1, SCHED_POLICY_CFS);
+    sched_set_process_policy(p2, SCHED_POLICY_CFS);
+    debug_print("DEBUG: EDF admission test complete");
+}
+
 void test_scheduler(void) {
     debug_print("DEBUG: Testing scheduler started.");
     
@@ -158,6 +202,7 @@ void process_test(void) {
     
     // test_queue_operations();
     // test_process_creation();
+    test_edf_admission();
     create_process(get_new_pid(), (uint32_t*)test_scheduler, 1, 2, 3);
     schedule();
     
@@ -1,6 +1,7 @@
 #include "../process/process.h"
 #include "../process/syscall.h"
 #include "../memory/memory.h"
+#include "../interrupts/timer.h"
 extern void debug_print(const char* messe);
 extern void print_to_screen(const char* message);
 extern void debug_int(int val);
@@ -109,6 +110,49 @@ void test_multiple_forks(void) {
     yield_syscall();
 }
 
+void test_waitpid_nohang(void) {
+    debug_print("DEBUG: Testing waitpid with WNOHANG");
+
+    int child_pid = fork_syscall();
+    if (child_pid == 0) {
+        yield_syscall();
+        exit_syscall(7);
+    } else if (child_pid > 0) {
+        int status = 0;
+        int early = waitpid_syscall(child_pid, &status, WNOHANG);
+        int result = waitpid_syscall(child_pid, &status, 0);
+        int again = waitpid_syscall(child_pid, &status, WNOHANG);
+
+        if ((early == 0 || early == child_pid) && (early == child_pid || result == child_pid)
+                && status == 7 && again == -1) {
+            debug_print("DEBUG: Waitpid test PASSED");
+        } else {
+            debug_print("DEBUG: Waitpid test FAILED");
+        }
+    } else {
+        debug_print("DEBUG: Fork failed");
+    }
+    current_process->state = STATE_EXIT;
+    yield_syscall();
+}
+
+void test_sleep(void) {
+    debug_print("DEBUG: Testing sleep");
+
+    uint32_t start = timer_ticks;
+    sleep_syscall(100);
+    uint32_t elapsed = timer_ticks - start;
+
+    if (elapsed >= timer_ms_to_ticks(100)) {
+        debug_print("DEBUG: Sleep test PASSED");
+    } else {
+        debug_print("DEBUG: Sleep test FAILED, ticks elapsed:");
+        debug_int(elapsed);
+    }
+    current_process->state = STATE_EXIT;
+    yield_syscall();
+}
+
 void syscall_test(void) {
     debug_print("DEBUG: Starting fork and wait syscall tests");
     
@@ -117,6 +161,12 @@ void syscall_test(void) {
         debug_print("DEBUG: Failed to create parent process");
         return;
     }
+    if (create_process(get_new_pid(), (uint32_t*)test_waitpid_nohang, 1, 2, 3) == NULL) {
+        debug_print("DEBUG: Failed to create waitpid test process");
+    }
+    if (create_process(get_new_pid(), (uint32_t*)test_sleep, 1, 2, 3) == NULL) {
+        debug_print("DEBUG: Failed to create sleep test process");
+    }
     
     debug_print("DEBUG: Fork and wait syscall tests complete");
     exit_syscall(0); 
@@ -0,0 +1,127 @@
+; user_test.asm
+; Ring 3 test program for `process user test`. The kernel copies the image
+; to USER_CODE_BASE, so addresses are worked out relative to that.
+[bits 32]
+global user_test_start, user_test_end
+
+%define USER_CODE_BASE 0x40000000       ; must match paging.h
+%define ADDR(label) (USER_CODE_BASE + ((label) - user_test_start))
+
+%define SYS_EXIT    1                   ; must match syscall.h
+%define SYS_FORK    2
+%define SYS_WAITPID 3
+%define SYS_GETPID  6
+%define SYS_WRITE   7
+
+%define CPUID_SEP   (1 << 11)           ; as in syscall.c
+
+%define VDSO_TEXT   0xBFC02000          ; must match vdso.h
+%define VDSO_GETPID   (VDSO_TEXT + 0 * 8)
+%define VDSO_GETPPID  (VDSO_TEXT + 1 * 8)
+%define VDSO_CLOCK_NS (VDSO_TEXT + 3 * 8)
+
+user_test_start:
+    ; Both entry paths reach the same process
+    mov eax, SYS_GETPID
+    int 0x80
+    mov ebp, eax
+    mov eax, SYS_GETPID
+    call do_sysenter
+    cmp eax, ebp
+    jne fail
+
+    ; So does the vDSO, without entering the kernel
+    mov eax, VDSO_GETPID
+    call eax
+    cmp eax, ebp
+    jne fail
+
+    ; and its clock doesn't run backwards
+    mov eax, VDSO_CLOCK_NS
+    call eax
+    mov esi, eax
+    mov edi, edx
+    mov eax, VDSO_CLOCK_NS
+    call eax
+    sub eax, esi
+    sbb edx, edi
+    js fail
+
+    ; The child returns from a fork entered through int 0x80 and leaves
+    ; through sysenter where there is one; the parent collects its status
+    mov eax, SYS_FORK
+    int 0x80
+    test eax, eax
+    js fail
+    jnz .parent
+    mov eax, VDSO_GETPPID       ; the child's own identity page names us
+    call eax
+    mov ebx, 42
+    cmp eax, ebp
+    je .child_exit
+    mov ebx, 43
+.child_exit:
+    mov eax, SYS_EXIT
+    call do_sysenter
+.parent:
+    mov ebx, eax                ; child pid
+    sub esp, 4
+    mov esi, esp                ; &status
+    xor edi, edi
+    mov eax, SYS_WAITPID
+    call do_sysenter
+    cmp eax, ebx
+    jne fail
+    cmp dword [esp], 42
+    jne fail
+
+    ; A buffer in the kernel half is refused rather than read
+    mov eax, SYS_WRITE
+    mov ebx, 0x100000
+    mov esi, 16
+    int 0x80
+    cmp eax, -1
+    jne fail
+
+    mov ebx, ADDR(passed)
+    mov esi, passed_len
+    jmp finish
+fail:
+    mov ebx, ADDR(failed)
+    mov esi, failed_len
+finish:
+    mov eax, SYS_WRITE
+    int 0x80
+    mov eax, SYS_EXIT
+    xor ebx, ebx
+    int 0x80
+
+; EAX holds the number and EBX, ESI and EDI the arguments. Clobbers ECX and
+; EDX. Without SEP the kernel leaves the sysenter MSRs unset and the
+; instruction would raise #UD, so the call goes through int 0x80 instead.
+do_sysenter:
+    push eax
+    push ebx
+    mov eax, 1
+    cpuid
+    pop ebx
+    pop eax
+    test edx, CPUID_SEP
+    jz .int80
+    mov ecx, esp
+    mov edx, ADDR(.resume)
+    sysenter
+.resume:
+    ret
+.int80:
+    int 0x80
+    ret
+
+passed:     db "User mode test PASSED", 10
+passed_len  equ $ - passed
+failed:     db "User mode test FAILED", 10
+failed_len  equ $ - failed
+
+user_test_end:
+
+section .note.GNU-stack